@@ -0,0 +1,1085 @@
+/*bench.cpp*/
+
+//
+// Benchmarks for our set class. Build and run with:
+//
+//   make bench
+//
+// Each benchmark prints one line per configuration so the
+// numbers can be compared across changes. Benchmarks that take a
+// size read it from BENCH_N, if set (see bench_size), e.g.
+//
+//   BENCH_N=8000000 make bench BENCH=scan
+//
+
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>  // getenv, atoll
+#include <malloc.h> // mallinfo2
+#include <fcntl.h>  // open
+#include <unistd.h> // close, unlink
+
+using std::vector;
+
+#include "set.h"
+#include "btree_set.h"
+#include "string_set.h"
+#include "radix_set.h"
+#include "persistent_set.h"
+#include "mapped_set.h"
+#include "compressed_set.h"
+
+//
+// returns the best elapsed time of f() over a few runs, in
+// milliseconds; the first run over a big tree is usually slowed
+// by cold caches and TLB misses:
+//
+template <typename F>
+double time_ms(F f, int runs = 3)
+{
+  double best = 0.0;
+
+  for (int r = 0; r < runs; r++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+
+    double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    if (r == 0 || ms < best)
+      best = ms;
+  }
+
+  return best;
+}
+
+//
+// the # of keys for a benchmark whose default is n: BENCH_N from
+// the environment, if set, otherwise n.
+//
+long long bench_size(long long n)
+{
+  const char *env = std::getenv("BENCH_N");
+
+  if (env != nullptr && std::atoll(env) > 0)
+    return std::atoll(env);
+  else
+    return n;
+}
+
+//
+// fills S with n distinct random keys in [1, range]:
+//
+void fill_random(set<long long> &S, long long n, long long range, std::mt19937 &gen)
+{
+  std::uniform_int_distribution<long long> distrib(1, range);
+
+  while (S.size() != n)
+    S.insert(distrib(gen));
+}
+
+//
+// intersect: sweeps the ratio between the two set sizes, and
+// compares set::intersect against a plain linear merge of the
+// two thread lists to show where galloping starts to win.
+//
+void bench_intersect()
+{
+  std::mt19937 gen(2024);
+  const long long N = 2000000;
+
+  set<long long> Large;
+  fill_random(Large, N, N * 10, gen);
+
+  std::cout << "intersect: large=" << N << std::endl;
+
+  for (long long m = N; m >= 1000; m /= 4)
+  {
+    set<long long> Small;
+    fill_random(Small, m, N * 10, gen);
+
+    int hits1 = 0, hits2 = 0;
+
+    double merge = time_ms([&]() {
+      hits1 = 0;
+      auto s = Small.begin();
+      auto l = Large.begin();
+      while (s != Small.end() && l != Large.end())
+      {
+        if (*s < *l)
+          ++s;
+        else if (*l < *s)
+          ++l;
+        else
+        {
+          hits1++;
+          ++s;
+          ++l;
+        }
+      }
+    });
+
+    double adaptive = time_ms([&]() {
+      hits2 = Small.intersect(Large).size();
+    });
+
+    std::cout << "  ratio 1:" << (N / m)
+              << "  merge " << merge << " ms"
+              << "  intersect " << adaptive << " ms"
+              << ((hits1 == hits2) ? "" : "  MISMATCH") << std::endl;
+  }
+}
+
+//
+// insert_batch: inserts sorted batches of keys into a large set,
+// one insert at a time versus one insert_batch call.
+//
+void bench_insert_batch()
+{
+  std::mt19937 gen(2024);
+  const long long N = 1000000;
+
+  std::cout << "insert_batch: set=" << N << std::endl;
+
+  for (long long m = 1000; m <= 1000000; m *= 10)
+  {
+    set<long long> S1, S2;
+    fill_random(S1, N, N * 10, gen);
+    S2 = set<long long>(S1);
+
+    std::uniform_int_distribution<long long> distrib(1, N * 10);
+    vector<long long> batch;
+    for (long long i = 0; i < m; i++)
+      batch.push_back(distrib(gen));
+    std::sort(batch.begin(), batch.end());
+
+    double loop = time_ms([&]() {
+      for (long long x : batch)
+        S1.insert(x);
+    }, 1);
+
+    double batched = time_ms([&]() {
+      S2.insert_batch(batch.begin(), batch.end());
+    }, 1);
+
+    std::cout << "  batch " << m
+              << "  insert " << loop << " ms"
+              << "  insert_batch " << batched << " ms"
+              << ((S1.size() == S2.size()) ? "" : "  MISMATCH") << std::endl;
+  }
+}
+
+//
+// freeze: random contains() on sets of ints from L1-sized to well
+// past the last-level cache (64M keys, 256 MB), comparing the
+// pointer-based set with each frozen layout.
+//
+// The pointer-based set is only timed up to 4M keys; past that its
+// nodes alone take gigabytes, so the layouts are built straight from
+// sorted keys, one in each run of 4 consecutive ints.
+//
+template <typename Layout>
+double time_frozen(const frozen_set<int, Layout> &F, const vector<int> &queries, int &hits)
+{
+  return time_ms([&]() {
+    hits = 0;
+    for (int x : queries)
+      hits += F.contains(x);
+  });
+}
+
+void bench_freeze()
+{
+  std::mt19937 gen(2024);
+  const int Q = 1000000;
+  const int TREE_MAX = 4096000;
+
+  std::cout << "freeze: ns per contains" << std::endl;
+
+  for (int n = 1000; n <= 65536000; n *= 4)
+  {
+    std::uniform_int_distribution<int> distrib(1, n * 4);
+    bool timeTree = (n <= TREE_MAX);
+
+    set<int> S;
+    vector<int> keys;
+
+    if (timeTree)
+    {
+      while (S.size() != n)
+        S.insert(distrib(gen));
+
+      keys = S.toVector();
+    }
+    else
+    {
+      keys.reserve(n);
+      for (int i = 0; i < n; i++)
+        keys.push_back(4 * i + 1 + (int)(gen() % 4));
+    }
+
+    vector<int> queries;
+    for (int i = 0; i < Q; i++)
+      queries.push_back(distrib(gen));
+
+    int hits = 0, hits1 = 0, hits2 = 0, hits3 = 0;
+    double tree = 0;
+
+    if (timeTree)
+    {
+      tree = time_ms([&]() {
+        hits = 0;
+        for (int x : queries)
+          hits += S.contains(x);
+      });
+    }
+
+    double eytzinger = time_frozen(frozen_set<int, eytzinger_layout>(keys), queries, hits1);
+    double veb = time_frozen(frozen_set<int, veb_layout>(keys), queries, hits2);
+    double sorted = time_frozen(frozen_set<int, sorted_layout>(keys), queries, hits3);
+
+    bool same = ((!timeTree || hits == hits1) && hits1 == hits2 && hits1 == hits3);
+
+    std::cout << "  n=" << n << " (" << (n * sizeof(int) / 1024) << " KB of keys)";
+    if (timeTree)
+      std::cout << "  set " << (tree * 1e6 / Q);
+    else
+      std::cout << "  set -";
+    std::cout << "  eytzinger " << (eytzinger * 1e6 / Q)
+              << "  veb " << (veb * 1e6 / Q)
+              << "  sorted " << (sorted * 1e6 / Q)
+              << (same ? "" : "  MISMATCH") << std::endl;
+  }
+}
+
+//
+// btree_set: random contains() and a full scan, against set.
+//
+void bench_btree()
+{
+  std::mt19937 gen(2024);
+  const int N = 4000000;
+  const int Q = 1000000;
+
+  set<int> S;
+  btree_set<int> B;
+  std::uniform_int_distribution<int> distrib(1, N * 4);
+
+  while (S.size() != N)
+  {
+    int x = distrib(gen);
+    S.insert(x);
+    B.insert(x);
+  }
+
+  vector<int> queries;
+  for (int i = 0; i < Q; i++)
+    queries.push_back(distrib(gen));
+
+  int hits1 = 0, hits2 = 0;
+  long long sum1 = 0, sum2 = 0;
+
+  double tree = time_ms([&]() {
+    hits1 = 0;
+    for (int x : queries)
+      hits1 += S.contains(x);
+  });
+
+  double btree = time_ms([&]() {
+    hits2 = 0;
+    for (int x : queries)
+      hits2 += B.contains(x);
+  });
+
+  double treeScan = time_ms([&]() {
+    sum1 = 0;
+    for (auto iter = S.begin(); iter != S.end(); ++iter)
+      sum1 += *iter;
+  });
+
+  double btreeScan = time_ms([&]() {
+    sum2 = 0;
+    for (auto iter = B.begin(); iter != B.end(); ++iter)
+      sum2 += *iter;
+  });
+
+  std::cout << "btree_set: n=" << N << std::endl
+            << "  contains: set " << (tree * 1e6 / Q) << " ns/op"
+            << "  btree_set " << (btree * 1e6 / Q) << " ns/op" << std::endl
+            << "  scan: set " << (treeScan * 1e6 / N) << " ns/element"
+            << "  btree_set " << (btreeScan * 1e6 / N) << " ns/element"
+            << ((hits1 == hits2 && sum1 == sum2) ? "" : "  MISMATCH") << std::endl;
+}
+
+//
+// contains_batch: checks a batch of random keys against a large
+// set, with contains() in a loop and with contains_batch().
+//
+void bench_contains_batch()
+{
+  std::mt19937 gen(2024);
+  const long long N = 4000000;
+  const int Q = 1000000;
+
+  set<long long> S;
+  fill_random(S, N, N * 4, gen);
+
+  std::uniform_int_distribution<long long> distrib(1, N * 4);
+  vector<long long> keys;
+  for (int i = 0; i < Q; i++)
+    keys.push_back(distrib(gen));
+
+  vector<unsigned long long> bits;
+  int hits1 = 0, hits2 = 0;
+
+  double loop = time_ms([&]() {
+    hits1 = 0;
+    for (long long x : keys)
+      hits1 += S.contains(x);
+  });
+
+  double batched = time_ms([&]() {
+    S.contains_batch(keys, bits);
+    hits2 = 0;
+    for (unsigned long long word : bits)
+      hits2 += __builtin_popcountll(word);
+  });
+
+  std::cout << "contains_batch: n=" << N << std::endl
+            << "  contains " << (loop * 1e6 / Q) << " ns/key"
+            << "  contains_batch " << (batched * 1e6 / Q) << " ns/key"
+            << ((hits1 == hits2) ? "" : "  MISMATCH") << std::endl;
+}
+
+//
+// scan: a full in-order scan of a large set, with the iterator and
+// with for_each with and without prefetching. 50M keys by default,
+// so the nodes (over 2 GB) are well past the last-level cache;
+// BENCH_N sets a different size.
+//
+void bench_scan()
+{
+  std::mt19937 gen(2024);
+  const long long N = bench_size(50000000);
+
+  set<long long> S;
+  fill_random(S, N, N * 4, gen);
+
+  long long sum1 = 0, sum2 = 0, sum3 = 0;
+
+  double iter = time_ms([&]() {
+    sum1 = 0;
+    for (auto it = S.begin(); it != S.end(); ++it)
+      sum1 += *it;
+  });
+
+  double plain = time_ms([&]() {
+    sum2 = 0;
+    S.for_each([&](long long x) { sum2 += x; }, false);
+  });
+
+  double prefetched = time_ms([&]() {
+    sum3 = 0;
+    S.for_each([&](long long x) { sum3 += x; }, true);
+  });
+
+  double compacting = time_ms([&]() {
+    S.compact();
+  }, 1);
+
+  long long sum4 = 0;
+
+  double compacted = time_ms([&]() {
+    sum4 = 0;
+    for (auto it = S.begin(); it != S.end(); ++it)
+      sum4 += *it;
+  });
+
+  std::cout << "scan: n=" << N << ", ns/element" << std::endl
+            << "  iterator " << (iter * 1e6 / N)
+            << "  for_each " << (plain * 1e6 / N)
+            << "  for_each+prefetch " << (prefetched * 1e6 / N)
+            << "  iterator after compact " << (compacted * 1e6 / N)
+            << " (compact took " << compacting << " ms)"
+            << ((sum1 == sum2 && sum1 == sum3 && sum1 == sum4) ? "" : "  MISMATCH") << std::endl;
+}
+
+//
+// strings: contains() on a large set<std::string>, with key
+// prefixes in the nodes (std::string) and without (plain_string,
+// the same keys with set_key_prefix left disabled).
+//
+struct plain_string
+{
+  std::string S;
+
+  bool operator<(const plain_string &other) const { return this->S < other.S; }
+};
+
+void bench_strings()
+{
+  std::mt19937 gen(38);
+  const int N = 1000000;
+  const int Q = 1000000;
+
+  std::uniform_int_distribution<int> len(20, 40), ch('a', 'z');
+
+  auto random_key = [&]() {
+    std::string s;
+    int n = len(gen);
+    for (int i = 0; i < n; i++)
+      s += (char)ch(gen);
+    return s;
+  };
+
+  set<std::string> S;
+  set<plain_string> P;
+  vector<std::string> keys;
+
+  for (int i = 0; i < N; i++)
+  {
+    std::string s = random_key();
+    S.insert(s);
+    P.insert(plain_string{s});
+    keys.push_back(s);
+  }
+
+  //
+  // half hits, half misses, in random order:
+  //
+  for (int i = 0; i < Q / 2; i++)
+    keys.push_back(random_key());
+  std::shuffle(keys.begin(), keys.end(), gen);
+  keys.resize(Q);
+
+  vector<plain_string> plain;
+  for (std::string &k : keys)
+    plain.push_back(plain_string{k});
+
+  int hits1 = 0, hits2 = 0;
+
+  double prefixed = time_ms([&]() {
+    hits1 = 0;
+    for (std::string &k : keys)
+      hits1 += S.contains(k);
+  });
+
+  double unprefixed = time_ms([&]() {
+    hits2 = 0;
+    for (plain_string &k : plain)
+      hits2 += P.contains(k);
+  });
+
+  std::cout << "strings: n=" << N << ", ns/lookup" << std::endl
+            << "  without prefix " << (unprefixed * 1e6 / Q)
+            << "  with prefix " << (prefixed * 1e6 / Q)
+            << ((hits1 == hits2) ? "" : "  MISMATCH") << std::endl;
+}
+
+//
+// urls: heap used by 2M URL-like keys in set<std::string> and in
+// string_set, and contains() on each.
+//
+size_t heap_bytes()
+{
+  return mallinfo2().uordblks;
+}
+
+void bench_urls()
+{
+  std::mt19937 gen(39);
+  const int N = 2000000;
+  const int Q = 1000000;
+
+  std::uniform_int_distribution<int> host(0, 20000), path(0, 1000000), kind(0, 3);
+  const char *kinds[] = {"article", "user", "images/full", "search?q="};
+
+  vector<std::string> keys;
+  for (int i = 0; i < N; i++)
+    keys.push_back("https://www.site" + std::to_string(host(gen)) + ".example.com/" +
+                   kinds[kind(gen)] + "/" + std::to_string(path(gen)));
+
+  size_t before = heap_bytes();
+  set<std::string> *S = new set<std::string>();
+  for (std::string &k : keys)
+    S->insert(k);
+  size_t tree = heap_bytes() - before;
+
+  before = heap_bytes();
+  string_set *F = new string_set(keys);
+  size_t compressed = heap_bytes() - before;
+
+  size_t chars = 0;
+  for (std::string &k : keys)
+    chars += k.size();
+
+  std::shuffle(keys.begin(), keys.end(), gen);
+  keys.resize(Q);
+
+  int hits1 = 0, hits2 = 0;
+
+  double t1 = time_ms([&]() {
+    hits1 = 0;
+    for (std::string &k : keys)
+      hits1 += S->contains(k);
+  });
+
+  double t2 = time_ms([&]() {
+    hits2 = 0;
+    for (std::string &k : keys)
+      hits2 += F->contains(k);
+  });
+
+  std::cout << "urls: n=" << S->size() << ", " << (double)chars / N << " chars/key" << std::endl
+            << "  set<string> " << (double)tree / S->size() << " bytes/key, " << (t1 * 1e6 / Q) << " ns/lookup" << std::endl
+            << "  string_set  " << (double)compressed / F->size() << " bytes/key, " << (t2 * 1e6 / Q) << " ns/lookup"
+            << ((hits1 == hits2) ? "" : "  MISMATCH") << std::endl;
+
+  delete S;
+  delete F;
+}
+
+//
+// radix: set<long long> vs radix_set<long long> on dense keys (half
+// of [0, 2N)) and sparse keys (random 64-bit): contains, and a
+// scan with the iterator.
+//
+template <typename TSet>
+void bench_radix_one(const char *name, TSet &S, const vector<long long> &probes)
+{
+  long long hits = 0, sum = 0;
+
+  double lookups = time_ms([&]() {
+    hits = 0;
+    for (long long x : probes)
+      hits += S.contains(x);
+  });
+
+  double scan = time_ms([&]() {
+    sum = 0;
+    for (auto it = S.begin(); it != S.end(); ++it)
+      sum += *it;
+  });
+
+  std::cout << "  " << name << ": contains " << (lookups * 1e6 / probes.size()) << " ns"
+            << ", scan " << (scan * 1e6 / S.size()) << " ns/element"
+            << "  (" << hits << " hits, sum " << sum << ")" << std::endl;
+}
+
+void bench_radix()
+{
+  const int N = 2000000;
+
+  for (bool dense : {true, false})
+  {
+    std::mt19937_64 gen(40);
+    std::uniform_int_distribution<long long> distrib = dense
+        ? std::uniform_int_distribution<long long>(0, 2LL * N)
+        : std::uniform_int_distribution<long long>(-(1LL << 62), 1LL << 62);
+
+    set<long long> S;
+    radix_set<long long> R;
+    vector<long long> probes;
+
+    while (S.size() != N)
+    {
+      long long x = distrib(gen);
+      S.insert(x);
+      R.insert(x);
+    }
+    for (int i = 0; i < N; i++)
+      probes.push_back(distrib(gen));
+
+    std::cout << "radix: n=" << N << (dense ? ", dense" : ", sparse") << std::endl;
+    bench_radix_one("set      ", S, probes);
+    bench_radix_one("radix_set", R, probes);
+  }
+}
+
+//
+// bloom: contains() on a large set where 95% of the probes miss,
+// without and with a filter at a few sizes.
+//
+void bench_bloom()
+{
+  std::mt19937 gen(41);
+  const long long N = 4000000;
+  const int Q = 1000000;
+
+  set<long long> S;
+  fill_random(S, N, 1LL << 40, gen);
+
+  vector<long long> probes;
+  std::uniform_int_distribution<long long> distrib(1, 1LL << 40);
+  vector<long long> present = S.toVector();
+  std::uniform_int_distribution<size_t> pick(0, present.size() - 1);
+
+  for (int i = 0; i < Q; i++)
+    probes.push_back((i % 20 == 0) ? present[pick(gen)] : distrib(gen));
+
+  std::cout << "bloom: n=" << N << ", 95% misses, ns/lookup" << std::endl;
+
+  for (int bits : {0, 6, 10, 16})
+  {
+    if (bits == 0)
+      S.disable_filter();
+    else
+      S.enable_filter(bits);
+
+    int hits = 0;
+    double t = time_ms([&]() {
+      hits = 0;
+      for (long long x : probes)
+        hits += S.contains(x);
+    });
+
+    std::cout << "  " << (bits == 0 ? std::string("no filter") : std::to_string(bits) + " bits/key")
+              << " " << (t * 1e6 / Q) << " (" << hits << " hits)" << std::endl;
+  }
+}
+
+//
+// returns q probes drawn from keys with Zipf(1) weights: the key at
+// rank r is drawn with probability proportional to 1 / r, so the
+// first 1% of ranks get most of the draws:
+//
+vector<long long> zipf_probes(const vector<long long> &keys, int q, std::mt19937 &gen)
+{
+  vector<double> weights;
+  for (size_t r = 1; r <= keys.size(); r++)
+    weights.push_back(1.0 / r);
+
+  std::discrete_distribution<size_t> rank(weights.begin(), weights.end());
+
+  vector<long long> probes;
+  for (int i = 0; i < q; i++)
+    probes.push_back(keys[rank(gen)]);
+
+  return probes;
+}
+
+//
+// cache: contains() on a large set with Zipf-distributed probes,
+// without and with lookup caches of a few sizes.
+//
+void bench_cache()
+{
+  std::mt19937 gen(42);
+  const long long N = 4000000;
+  const int Q = 2000000;
+
+  set<long long> S;
+  fill_random(S, N, N * 4, gen);
+
+  vector<long long> keys = S.toVector();
+  std::shuffle(keys.begin(), keys.end(), gen); // ranks in random key order
+  keys.resize(1000000);
+
+  vector<long long> probes = zipf_probes(keys, Q, gen);
+
+  std::cout << "cache: n=" << N << ", Zipf probes, ns/lookup" << std::endl;
+
+  for (int entries : {0, 1024, 16384, 262144})
+  {
+    if (entries == 0)
+      S.disable_cache();
+    else
+      S.enable_cache(entries);
+
+    int hits = 0;
+    double t = time_ms([&]() {
+      hits = 0;
+      for (long long x : probes)
+        hits += S.contains(x);
+    });
+
+    std::cout << "  " << (entries == 0 ? std::string("no cache") : std::to_string(entries) + " entries")
+              << " " << (t * 1e6 / Q);
+    if (entries != 0)
+      std::cout << " (hit rate " << 100.0 * S.cache_hits() / (S.cache_hits() + S.cache_misses()) << "%)";
+    std::cout << ((hits == Q) ? "" : "  MISMATCH") << std::endl;
+  }
+}
+
+//
+// splay: contains() with Zipf-distributed probes on a set built by
+// random inserts, as is, with the lookup cache, and splayed.
+//
+void bench_splay()
+{
+  std::mt19937 gen(43);
+  const long long N = 4000000;
+  const int Q = 2000000;
+
+  set<long long> S;
+  fill_random(S, N, N * 4, gen);
+
+  vector<long long> keys = S.toVector();
+  std::shuffle(keys.begin(), keys.end(), gen);
+  keys.resize(1000000);
+
+  vector<long long> probes = zipf_probes(keys, Q, gen);
+
+  std::cout << "splay: n=" << N << ", Zipf probes, ns/lookup" << std::endl;
+
+  auto run = [&](const char *name) {
+    int hits = 0;
+    double t = time_ms([&]() {
+      hits = 0;
+      for (long long x : probes)
+        hits += S.contains(x);
+    });
+
+    std::cout << "  " << name << " " << (t * 1e6 / Q) << ((hits == Q) ? "" : "  MISMATCH") << std::endl;
+  };
+
+  run("random inserts      ");
+
+  S.enable_cache(16384);
+  run("+ cache, 16K entries");
+  S.disable_cache();
+
+  S.balancing(set_balance::splay);
+  run("splay               ");
+}
+
+//
+// balance: inserting 1M keys, in random and in sorted order, then
+// looking up 1M random keys, for each balancing mode. Sorted
+// inserts without balancing build a list, so that case is skipped.
+//
+void bench_balance()
+{
+  const int N = 1000000;
+
+  std::mt19937 gen(44);
+  vector<long long> shuffled;
+  for (long long i = 0; i < N; i++)
+    shuffled.push_back(i * 2);
+  vector<long long> sorted = shuffled;
+  std::shuffle(shuffled.begin(), shuffled.end(), gen);
+
+  std::uniform_int_distribution<long long> distrib(0, 2LL * N);
+  vector<long long> probes;
+  for (int i = 0; i < N; i++)
+    probes.push_back(distrib(gen));
+
+  std::cout << "balance: n=" << N << std::endl;
+
+  struct MODE
+  {
+    const char *Name;
+    set_balance Mode;
+  };
+
+  for (MODE mode : {MODE{"none     ", set_balance::none}, MODE{"scapegoat", set_balance::scapegoat},
+                    MODE{"treap    ", set_balance::treap}})
+  {
+    for (bool inorder : {false, true})
+    {
+      if (inorder && mode.Mode == set_balance::none)
+        continue;
+
+      set<long long> S;
+      S.balancing(mode.Mode);
+
+      auto start = std::chrono::steady_clock::now();
+      for (long long x : (inorder ? sorted : shuffled))
+        S.insert(x);
+      double inserts = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      int hits = 0;
+      double lookups = time_ms([&]() {
+        hits = 0;
+        for (long long x : probes)
+          hits += S.contains(x);
+      });
+
+      std::cout << "  " << mode.Name << (inorder ? " sorted" : " random")
+                << ": insert " << (inserts * 1e6 / N) << " ns, height " << S.height()
+                << ", contains " << (lookups * 1e6 / N) << " ns (" << hits << " hits)" << std::endl;
+    }
+  }
+}
+
+//
+// copy: a request handler copying a shared set of 1M keys and
+// inserting a few keys of its own, for set (a deep copy) and
+// persistent_set (a shared root, then path copies); then lookups
+// in both, since persistent_set pays for its sharing with a
+// pointer chase through shared_ptr per level.
+//
+void bench_copy()
+{
+  const int N = 1000000, COPIES = 20, OWN = 10;
+
+  std::mt19937 gen(46);
+  std::uniform_int_distribution<long long> distrib(0, 4LL * N);
+
+  set<long long> S;
+  fill_random(S, N, 4LL * N, gen);
+  persistent_set<long long> P(S.toVector());
+
+  vector<long long> probes;
+  for (int i = 0; i < N; i++)
+    probes.push_back(distrib(gen));
+
+  std::cout << "copy: n=" << S.size() << ", " << OWN << " inserts per copy" << std::endl;
+
+  double deep = time_ms([&]() {
+    for (int c = 0; c < COPIES; c++)
+    {
+      set<long long> mine = S;
+      for (int i = 0; i < OWN; i++)
+        mine.insert(distrib(gen));
+    }
+  });
+
+  double shared = time_ms([&]() {
+    for (int c = 0; c < COPIES; c++)
+    {
+      persistent_set<long long> mine = P;
+      for (int i = 0; i < OWN; i++)
+        mine.insert(distrib(gen));
+    }
+  });
+
+  int hits = 0;
+  double lookupS = time_ms([&]() {
+    hits = 0;
+    for (long long x : probes)
+      hits += S.contains(x);
+  });
+  double lookupP = time_ms([&]() {
+    hits = 0;
+    for (long long x : probes)
+      hits += P.contains(x);
+  });
+
+  std::cout << "  set           : copy+inserts " << (deep * 1e3 / COPIES) << " us, contains "
+            << (lookupS * 1e6 / N) << " ns" << std::endl;
+  std::cout << "  persistent_set: copy+inserts " << (shared * 1e3 / COPIES) << " us, contains "
+            << (lookupP * 1e6 / N) << " ns (" << hits << " hits)" << std::endl;
+}
+
+//
+// checkpoint: saving a set of 10M keys to a file and loading it
+// back, against rebuilding it from its keys with n inserts (in
+// random order; sorted, as toVector returns them, the tree would be
+// a list). The file is read back while still in the page cache, so
+// the numbers are for the CPU side only.
+//
+void bench_checkpoint()
+{
+  const int N = 10000000;
+  const char *path = "/tmp/bench_checkpoint.set";
+
+  std::mt19937 gen(48);
+  set<long long> S;
+  fill_random(S, N, 1LL << 40, gen);
+  vector<long long> keys = S.toVector();
+
+  std::cout << "checkpoint: n=" << N << ", " << (N * 8 >> 20) << " MB of keys" << std::endl;
+
+  double save = time_ms([&]() {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    S.save(fd);
+    close(fd);
+  });
+
+  S.compact(); // now the walk reads the nodes in memory order
+  double saveCompact = time_ms([&]() {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    S.save(fd);
+    close(fd);
+  });
+
+  set<long long> L;
+  double load = time_ms([&]() {
+    int fd = open(path, O_RDONLY);
+    L.load(fd);
+    close(fd);
+  });
+  unlink(path);
+
+  vector<long long> shuffled = keys;
+  std::shuffle(shuffled.begin(), shuffled.end(), gen);
+
+  double inserts = time_ms([&]() {
+    set<long long> R;
+    for (long long x : shuffled)
+      R.insert(x);
+  }, 1);
+
+  std::cout << "  save          : " << save << " ms (" << (N * 8.0 / 1e6) / (save / 1e3) << " MB/s)" << std::endl;
+  std::cout << "  save, compact : " << saveCompact << " ms (" << (N * 8.0 / 1e6) / (saveCompact / 1e3) << " MB/s)"
+            << std::endl;
+  std::cout << "  load          : " << load << " ms (" << (N * 8.0 / 1e6) / (load / 1e3) << " MB/s), "
+            << (L.toVector() == keys ? "same keys" : "DIFFERENT KEYS") << std::endl;
+  std::cout << "  n inserts     : " << inserts << " ms" << std::endl;
+}
+
+//
+// mapped: opening a mapped_set of 10M keys, against building the
+// same frozen_set in memory from a set, then contains in each. The
+// file is in the page cache, as it is for every process but the
+// first on a host.
+//
+void bench_mapped()
+{
+  const int N = 10000000;
+  const char *path = "/tmp/bench_mapped.set";
+
+  std::mt19937 gen(49);
+  vector<long long> keys;
+  for (long long i = 0; i < N; i++)
+    keys.push_back(i * 3);
+
+  set<long long> S;
+  S.insert_batch(keys.begin(), keys.end());
+
+  std::uniform_int_distribution<long long> distrib(0, 3LL * N);
+  vector<long long> probes;
+  for (int i = 0; i < 1000000; i++)
+    probes.push_back(distrib(gen));
+
+  mapped_set<long long>::write(path, S.toVector());
+
+  std::cout << "mapped: n=" << N << std::endl;
+
+  double freeze = time_ms([&]() { S.freeze(); }, 1);
+  frozen_set<long long> F = S.freeze();
+
+  double open = time_ms([&]() { mapped_set<long long> M(path); });
+  mapped_set<long long> M(path);
+
+  int hits = 0;
+  double lookupF = time_ms([&]() {
+    hits = 0;
+    for (long long x : probes)
+      hits += F.contains(x);
+  });
+  double lookupM = time_ms([&]() {
+    hits = 0;
+    for (long long x : probes)
+      hits += M.contains(x);
+  });
+  std::remove(path);
+
+  std::cout << "  frozen_set: build " << freeze << " ms, contains " << (lookupF * 1e6 / probes.size()) << " ns"
+            << std::endl;
+  std::cout << "  mapped_set: open  " << open << " ms, contains " << (lookupM * 1e6 / probes.size()) << " ns ("
+            << hits << " hits)" << std::endl;
+}
+
+//
+// compressed: 10M IDs with random gaps averaging 50, as set<long
+// long> and as compressed_set: bytes per key, contains, and a scan.
+//
+void bench_compressed()
+{
+  const int N = 10000000;
+
+  std::mt19937 gen(50);
+  std::uniform_int_distribution<long long> gap(1, 99);
+  vector<long long> keys;
+  long long id = 1000000000;
+  for (int i = 0; i < N; i++)
+    keys.push_back(id += gap(gen));
+
+  std::uniform_int_distribution<long long> distrib(keys.front(), keys.back());
+  vector<long long> probes;
+  for (int i = 0; i < 1000000; i++)
+    probes.push_back(distrib(gen));
+
+  size_t before = heap_bytes();
+  set<long long> S;
+  S.insert_batch(keys.begin(), keys.end());
+  size_t setBytes = heap_bytes() - before;
+
+  compressed_set<long long> C(keys);
+
+  std::cout << "compressed: n=" << N << std::endl;
+
+  struct RESULT
+  {
+    double Contains, Scan;
+  };
+
+  auto run = [&](auto &X) {
+    int hits = 0;
+    long long sum = 0;
+    RESULT r;
+
+    r.Contains = time_ms([&]() {
+      hits = 0;
+      for (long long x : probes)
+        hits += X.contains(x);
+    }) * 1e6 / probes.size();
+
+    r.Scan = time_ms([&]() {
+      sum = 0;
+      for (auto iter = X.begin(); iter != X.end(); ++iter)
+        sum += *iter;
+    }) * 1e6 / N;
+
+    if (sum == 0 || hits == 0)
+      std::cout << "  (unexpected result)" << std::endl;
+
+    return r;
+  };
+
+  RESULT s = run(S), c = run(C);
+
+  std::cout << "  set           : " << (double)setBytes / N << " bytes/key, contains " << s.Contains
+            << " ns, scan " << s.Scan << " ns/key" << std::endl;
+  std::cout << "  compressed_set: " << (double)C.bytes() / N << " bytes/key, contains " << c.Contains
+            << " ns, scan " << c.Scan << " ns/key" << std::endl;
+}
+
+//
+// runs every benchmark, or only those named on the command line,
+// e.g. ./bench.out freeze btree
+//
+int main(int argc, char *argv[])
+{
+  std::vector<std::pair<std::string, void (*)()>> benchmarks = {
+      {"intersect", bench_intersect},
+      {"insert_batch", bench_insert_batch},
+      {"freeze", bench_freeze},
+      {"btree", bench_btree},
+      {"contains_batch", bench_contains_batch},
+      {"scan", bench_scan},
+      {"strings", bench_strings},
+      {"urls", bench_urls},
+      {"radix", bench_radix},
+      {"bloom", bench_bloom},
+      {"cache", bench_cache},
+      {"splay", bench_splay},
+      {"balance", bench_balance},
+      {"copy", bench_copy},
+      {"checkpoint", bench_checkpoint},
+      {"mapped", bench_mapped},
+      {"compressed", bench_compressed},
+  };
+
+  for (auto &b : benchmarks)
+  {
+    bool run = (argc == 1);
+
+    for (int i = 1; i < argc; i++)
+      run = run || (b.first == argv[i]);
+
+    if (run)
+      b.second();
+  }
+
+  return 0;
+}
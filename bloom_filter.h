@@ -0,0 +1,134 @@
+/*bloom_filter.h*/
+
+//
+// A blocked Bloom filter, kept by set (see set::enable_filter) to
+// answer most lookups of absent keys without a descent.
+//
+// A Bloom filter never says no to a key that was added, and says
+// yes to an absent key with a small probability that depends on the
+// # of bits per key. In a blocked filter all the bits of a key lie
+// in one 64-byte block, chosen by the key's hash, so a test costs a
+// single cache miss however many bits are checked.
+//
+// Keys cannot be removed; a filter only grows stale (more false
+// yeses) and is rebuilt from the keys to get rid of them.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef> // size_t
+
+#include "set_hash.h"
+
+template <typename TKey>
+class bloom_filter
+{
+private:
+  struct alignas(64) BLOCK
+  {
+    unsigned long long Words[8]; // 512 bits
+  };
+
+  std::vector<BLOCK> Blocks;
+  int BitsPerKey;
+  int Hashes;      // # of bits set per key
+  size_t Capacity; // # of keys the filter was sized for
+  size_t Count;    // # of keys added
+
+  //
+  // the block is picked by the high half of the hash, and the bits
+  // within it by double hashing on a second mix of it:
+  //
+  size_t _block(unsigned long long h) const
+  {
+    return ((h >> 32) * this->Blocks.size()) >> 32;
+  }
+
+public:
+  //
+  // constructor:
+  //
+  // Sizes the filter for capacity keys at bitsPerKey bits each;
+  // about 0.7 * bitsPerKey bits are set per key, which gives the
+  // fewest false positives.
+  //
+  bloom_filter(size_t capacity, int bitsPerKey)
+      : BitsPerKey(bitsPerKey), Capacity(capacity), Count(0)
+  {
+    size_t blocks = (capacity * bitsPerKey + 511) / 512;
+
+    this->Blocks.assign(blocks == 0 ? 1 : blocks, BLOCK{});
+    this->Hashes = (bitsPerKey * 69 + 50) / 100;
+
+    if (this->Hashes < 1)
+      this->Hashes = 1;
+    else if (this->Hashes > 16)
+      this->Hashes = 16;
+  }
+
+  int bitsPerKey() const { return this->BitsPerKey; }
+  size_t capacity() const { return this->Capacity; }
+
+  // true once more keys were added than the filter was sized for:
+  bool full() const { return this->Count > this->Capacity; }
+
+  void add(const TKey &key)
+  {
+    unsigned long long h = set_hash(key);
+    BLOCK &block = this->Blocks[_block(h)];
+
+    unsigned long long g = h * 0x9e3779b97f4a7c15ULL;
+    unsigned a = (unsigned)g, b = (unsigned)(g >> 32) | 1;
+
+    for (int i = 0; i < this->Hashes; i++, a += b)
+      block.Words[(a >> 6) & 7] |= 1ULL << (a & 63);
+
+    this->Count++;
+  }
+
+  //
+  // false => key was never added; true => it probably was:
+  //
+  bool mayContain(const TKey &key) const
+  {
+    unsigned long long h = set_hash(key);
+    const BLOCK &block = this->Blocks[_block(h)];
+
+    unsigned long long g = h * 0x9e3779b97f4a7c15ULL;
+    unsigned a = (unsigned)g, b = (unsigned)(g >> 32) | 1;
+
+    for (int i = 0; i < this->Hashes; i++, a += b)
+    {
+      if ((block.Words[(a >> 6) & 7] & (1ULL << (a & 63))) == 0)
+        return false;
+    }
+
+    return true;
+  }
+
+  //
+  // merge
+  //
+  // Adds the keys of other, if both filters have the same shape;
+  // returns false (and does nothing) if they don't.
+  //
+  bool merge(const bloom_filter &other)
+  {
+    if (other.Blocks.size() != this->Blocks.size() || other.Hashes != this->Hashes)
+      return false;
+
+    for (size_t i = 0; i < this->Blocks.size(); i++)
+    {
+      for (int w = 0; w < 8; w++)
+        this->Blocks[i].Words[w] |= other.Blocks[i].Words[w];
+    }
+
+    this->Count += other.Count;
+
+    return true;
+  }
+};
@@ -0,0 +1,518 @@
+/*btree_set.h*/
+
+//
+// A set in the mathematical sense, with no duplicates, stored as a
+// B+ tree with wide nodes. Offers the same interface as set (insert,
+// contains, [], find, begin/end, toVector, size) so it can be used
+// in place of it.
+//
+// A node of set holds one key, so each level of a search is a cache
+// miss that yields one comparison. Here a node holds up to NodeBytes
+// worth of keys (clamped to 8..64 keys), so each miss yields several
+// comparisons and the tree is much shallower. All keys live in the
+// leaves; the leaves are linked left to right by Next pointers,
+// which play the role the right-threads play in set: iteration just
+// walks the leaf chain.
+//
+// TKey must be default constructible, since nodes hold fixed-size
+// arrays of keys.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <utility> // std::swap
+
+#include "simd_search.h"
+
+template <typename TKey, int NodeBytes = 256>
+class btree_set
+{
+private:
+  // #################################################################
+  //
+  // nodes:
+  //
+  // # of keys per node; one extra slot lets a node overflow by one
+  // key before it is split.
+  //
+  static const int CAPACITY =
+      (NodeBytes / (int)sizeof(TKey) < 8)    ? 8
+      : (NodeBytes / (int)sizeof(TKey) > 64) ? 64
+                                             : NodeBytes / (int)sizeof(TKey);
+
+  struct NODE
+  {
+    bool isLeaf;
+    int Count; // # of keys in use
+
+    NODE(bool leaf)
+        : isLeaf(leaf), Count(0)
+    {
+    }
+  };
+
+  //
+  // a leaf holds Count keys, in order:
+  //
+  struct LEAF : public NODE
+  {
+    TKey Keys[CAPACITY + 1];
+    LEAF *Next; // leaf to the right, nullptr if last
+
+    LEAF()
+        : NODE(true), Next(nullptr)
+    {
+    }
+  };
+
+  //
+  // an inner node holds Count separator keys and Count + 1 children;
+  // Children[i] holds the keys k with Keys[i - 1] <= k < Keys[i]:
+  //
+  struct INNER : public NODE
+  {
+    TKey Keys[CAPACITY + 1];
+    NODE *Children[CAPACITY + 2];
+
+    INNER()
+        : NODE(false)
+    {
+    }
+  };
+
+  // #################################################################
+  //
+  // data members:
+  //
+  NODE *Root; // nullptr when empty
+  int Size;   // # of keys
+
+  // #################################################################
+  //
+  // in-node search, vectorized for int, long long and double (see
+  // simd_search.h):
+  //
+  // _lowerBound: index of the first key not less than key
+  // _upperBound: index of the first key greater than key
+  //
+  static int _lowerBound(TKey *keys, int count, TKey &key)
+  {
+    return simd_search<TKey>::lower_bound(keys, count, key);
+  }
+
+  static int _upperBound(TKey *keys, int count, TKey &key)
+  {
+    return simd_search<TKey>::upper_bound(keys, count, key);
+  }
+
+  //
+  // descends to the leaf that would hold key:
+  //
+  LEAF *_findLeaf(TKey &key)
+  {
+    NODE *cur = this->Root;
+
+    if (cur == nullptr)
+      return nullptr;
+
+    while (!cur->isLeaf)
+    {
+      INNER *inner = static_cast<INNER *>(cur);
+      cur = inner->Children[_upperBound(inner->Keys, inner->Count, key)];
+    }
+
+    return static_cast<LEAF *>(cur);
+  }
+
+  //
+  // _insert
+  //
+  // Inserts key into the subtree rooted at cur. Returns false if key
+  // was already present. If cur had to be split, the new right
+  // sibling is returned in newNode along with the smallest key below
+  // it in newKey; otherwise newNode is nullptr.
+  //
+  bool _insert(NODE *cur, TKey &key, NODE *&newNode, TKey &newKey)
+  {
+    newNode = nullptr;
+
+    if (cur->isLeaf)
+    {
+      LEAF *leaf = static_cast<LEAF *>(cur);
+      int i = _lowerBound(leaf->Keys, leaf->Count, key);
+
+      if (i < leaf->Count && !(key < leaf->Keys[i]))
+        return false; // already present
+
+      for (int j = leaf->Count; j > i; j--)
+        leaf->Keys[j] = leaf->Keys[j - 1];
+      leaf->Keys[i] = key;
+      leaf->Count++;
+
+      if (leaf->Count > CAPACITY)
+      {
+        //
+        // split: the upper half moves to a new leaf, which is
+        // linked in after this one:
+        //
+        LEAF *right = new LEAF();
+        int half = leaf->Count / 2;
+
+        for (int j = half; j < leaf->Count; j++)
+          right->Keys[j - half] = leaf->Keys[j];
+        right->Count = leaf->Count - half;
+        leaf->Count = half;
+
+        right->Next = leaf->Next;
+        leaf->Next = right;
+
+        newNode = right;
+        newKey = right->Keys[0];
+      }
+
+      return true;
+    }
+
+    INNER *inner = static_cast<INNER *>(cur);
+    int c = _upperBound(inner->Keys, inner->Count, key);
+
+    NODE *childNew;
+    TKey childKey;
+
+    if (!_insert(inner->Children[c], key, childNew, childKey))
+      return false;
+
+    if (childNew == nullptr)
+      return true;
+
+    //
+    // the child was split, add its new sibling after it:
+    //
+    for (int j = inner->Count; j > c; j--)
+    {
+      inner->Keys[j] = inner->Keys[j - 1];
+      inner->Children[j + 1] = inner->Children[j];
+    }
+    inner->Keys[c] = childKey;
+    inner->Children[c + 1] = childNew;
+    inner->Count++;
+
+    if (inner->Count > CAPACITY)
+    {
+      //
+      // split: the middle key moves up, the keys and children to
+      // its right move to a new node:
+      //
+      INNER *right = new INNER();
+      int half = inner->Count / 2;
+
+      newKey = inner->Keys[half];
+
+      for (int j = half + 1; j < inner->Count; j++)
+        right->Keys[j - half - 1] = inner->Keys[j];
+      for (int j = half + 1; j <= inner->Count; j++)
+        right->Children[j - half - 1] = inner->Children[j];
+
+      right->Count = inner->Count - half - 1;
+      inner->Count = half;
+
+      newNode = right;
+    }
+
+    return true;
+  }
+
+  void _destroy(NODE *cur)
+  {
+    if (cur == nullptr)
+      return;
+
+    if (cur->isLeaf)
+      delete static_cast<LEAF *>(cur);
+    else
+    {
+      INNER *inner = static_cast<INNER *>(cur);
+
+      for (int i = 0; i <= inner->Count; i++)
+        _destroy(inner->Children[i]);
+
+      delete inner;
+    }
+  }
+
+  LEAF *_firstLeaf()
+  {
+    NODE *cur = this->Root;
+
+    if (cur == nullptr)
+      return nullptr;
+
+    while (!cur->isLeaf)
+      cur = static_cast<INNER *>(cur)->Children[0];
+
+    return static_cast<LEAF *>(cur);
+  }
+
+public:
+  //
+  // default constructor:
+  //
+  btree_set()
+      : Root(nullptr), Size(0)
+  {
+  }
+
+  //
+  // copy constructor:
+  //
+  btree_set(const btree_set &other)
+      : Root(nullptr), Size(0)
+  {
+    for (LEAF *leaf = const_cast<btree_set &>(other)._firstLeaf(); leaf != nullptr; leaf = leaf->Next)
+    {
+      for (int i = 0; i < leaf->Count; i++)
+        this->insert(leaf->Keys[i]);
+    }
+  }
+
+  //
+  // move constructor:
+  //
+  // Takes over the nodes of other in O(1), leaving other empty.
+  //
+  btree_set(btree_set &&other)
+      : Root(other.Root), Size(other.Size)
+  {
+    other.Root = nullptr;
+    other.Size = 0;
+  }
+
+  //
+  // copy / move assignment:
+  //
+  // other is a copy, or the moved-from set; swapping with it hands
+  // the old nodes to other, which frees them on its way out.
+  //
+  btree_set &operator=(btree_set other)
+  {
+    std::swap(this->Root, other.Root);
+    std::swap(this->Size, other.Size);
+
+    return *this;
+  }
+
+  //
+  // destructor:
+  //
+  ~btree_set()
+  {
+    _destroy(this->Root);
+  }
+
+  //
+  // size
+  //
+  // Returns # of elements in the set
+  //
+  int size()
+  {
+    return this->Size;
+  }
+
+  //
+  // contains
+  //
+  // Returns true if set contains key, false if not
+  //
+  bool contains(TKey key)
+  {
+    LEAF *leaf = _findLeaf(key);
+
+    if (leaf == nullptr)
+      return false;
+
+    int i = _lowerBound(leaf->Keys, leaf->Count, key);
+
+    return i < leaf->Count && !(key < leaf->Keys[i]);
+  }
+
+  //
+  // insert
+  //
+  // Inserts the given key into the set; if the key is already in
+  // the set then this function has no effect.
+  //
+  void insert(TKey key)
+  {
+    if (this->Root == nullptr)
+      this->Root = new LEAF();
+
+    NODE *newNode;
+    TKey newKey;
+
+    if (!_insert(this->Root, key, newNode, newKey))
+      return;
+
+    if (newNode != nullptr)
+    {
+      //
+      // the root was split, grow the tree by one level:
+      //
+      INNER *root = new INNER();
+
+      root->Keys[0] = newKey;
+      root->Children[0] = this->Root;
+      root->Children[1] = newNode;
+      root->Count = 1;
+
+      this->Root = root;
+    }
+
+    this->Size++;
+  }
+
+  //
+  // []
+  //
+  // Returns true if set contains key, false if not.
+  //
+  bool operator[](TKey key)
+  {
+    return this->contains(key);
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order, in a vector.
+  //
+  std::vector<TKey> toVector()
+  {
+    std::vector<TKey> V;
+    V.reserve(this->Size);
+
+    for (LEAF *leaf = _firstLeaf(); leaf != nullptr; leaf = leaf->Next)
+    {
+      for (int i = 0; i < leaf->Count; i++)
+        V.push_back(leaf->Keys[i]);
+    }
+
+    return V;
+  }
+
+  // #################################################################
+  //
+  // class iterator:
+  //
+  // Denotes a key by its leaf and position in the leaf; advancing
+  // past the last key of a leaf follows the leaf's Next pointer.
+  //
+  class iterator
+  {
+  private:
+    LEAF *Leaf; // nullptr => end
+    int Index;
+
+  public:
+    iterator(LEAF *leaf, int index)
+        : Leaf(leaf), Index(index)
+    {
+    }
+
+    TKey operator*()
+    {
+      if (this->Leaf == nullptr)
+        throw std::out_of_range("btree_set::iterator:operator*");
+
+      return this->Leaf->Keys[this->Index];
+    }
+
+    bool operator==(iterator other)
+    {
+      return this->Leaf == other.Leaf && this->Index == other.Index;
+    }
+
+    bool operator!=(iterator other)
+    {
+      return !(*this == other);
+    }
+
+    void operator++()
+    {
+      if (this->Leaf == nullptr)
+        return;
+
+      this->Index++;
+
+      if (this->Index == this->Leaf->Count)
+      {
+        this->Leaf = this->Leaf->Next;
+        this->Index = 0;
+      }
+    }
+  };
+
+  //
+  // find:
+  //
+  // If the set contains key, then an iterator denoting this
+  // element is returned. If the set does not contain key,
+  // then set.end() is returned.
+  //
+  iterator find(TKey key)
+  {
+    LEAF *leaf = _findLeaf(key);
+
+    if (leaf != nullptr)
+    {
+      int i = _lowerBound(leaf->Keys, leaf->Count, key);
+
+      if (i < leaf->Count && !(key < leaf->Keys[i]))
+        return iterator(leaf, i);
+    }
+
+    return this->end();
+  }
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first element that is not
+  // less than key, or end() if there is no such element.
+  //
+  iterator lower_bound(TKey key)
+  {
+    LEAF *leaf = _findLeaf(key);
+
+    if (leaf == nullptr)
+      return this->end();
+
+    int i = _lowerBound(leaf->Keys, leaf->Count, key);
+
+    if (i < leaf->Count)
+      return iterator(leaf, i);
+    else // first key of the next leaf, if any:
+      return iterator(leaf->Next, 0);
+  }
+
+  iterator begin()
+  {
+    LEAF *leaf = _firstLeaf();
+
+    if (leaf == nullptr || leaf->Count == 0)
+      return this->end();
+
+    return iterator(leaf, 0);
+  }
+
+  iterator end()
+  {
+    return iterator(nullptr, 0);
+  }
+};
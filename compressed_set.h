@@ -0,0 +1,334 @@
+/*compressed_set.h*/
+
+//
+// An immutable set of integers, stored compressed. Offers the
+// read-only interface of set (contains, [], find, lower_bound,
+// begin/end, toVector, size), and is built from sorted keys, e.g.
+// the output of set<long long>::toVector().
+//
+// A node of set<long long> takes 32 bytes (two links, the thread
+// bit and the key, padded), plus the allocator's overhead, for 8
+// bytes of key. Sorted IDs are mostly small steps apart, so here
+// the keys are kept in blocks of BLOCK_KEYS, each written as the
+// differences between consecutive keys, in varint form (7 bits
+// per byte, low bits first):
+//
+//   <key 2 - key 1> <key 3 - key 2> ... <key n - key n-1>
+//
+// The first key of every block is kept whole in a separate array,
+// together with where the block's bytes start; this is the skip
+// index. A lookup binary searches the first keys, then decodes a
+// single block up to the key, so it reads a few cache lines of
+// index and one block. Keys 1,000 apart take 2 bytes each, plus
+// 16 bytes of index per block.
+//
+// Iterating decodes one difference after another, never a whole
+// block, the same walk in sorted order that the threads provide in
+// set.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+
+template <typename TKey>
+class compressed_set
+{
+  static_assert(std::is_integral<TKey>::value, "compressed_set: TKey must be an integral type");
+
+private:
+  //
+  // Keys are mapped to unsigned values of the same order, flipping
+  // the sign bit of signed types, so differences are never negative:
+  //
+  typedef unsigned long long UKEY;
+
+  static const int BITS = 8 * sizeof(TKey);
+  static const int BLOCK_KEYS = 128;
+
+  static UKEY _toUnsigned(TKey key)
+  {
+    UKEY u = (UKEY)(typename std::make_unsigned<TKey>::type)key;
+
+    if (std::is_signed<TKey>::value)
+      u ^= (UKEY)1 << (BITS - 1);
+
+    return u;
+  }
+
+  static TKey _toKey(UKEY u)
+  {
+    if (std::is_signed<TKey>::value)
+      u ^= (UKEY)1 << (BITS - 1);
+
+    return (TKey)u;
+  }
+
+  // #################################################################
+  //
+  // blocks:
+  //
+  std::vector<UKEY> First;         // first key of each block
+  std::vector<size_t> Offset;       // where each block's differences start in Data
+  std::vector<unsigned char> Data;  // the differences
+  size_t N;                         // # of keys
+
+  static void _putVarint(std::vector<unsigned char> &out, UKEY n)
+  {
+    while (n >= 0x80)
+    {
+      out.push_back((unsigned char)(0x80 | (n & 0x7f)));
+      n >>= 7;
+    }
+    out.push_back((unsigned char)n);
+  }
+
+  static UKEY _getVarint(const unsigned char *&pos)
+  {
+    UKEY n = *pos++;
+
+    if (n < 0x80) // one byte, by far the most common case
+      return n;
+
+    n &= 0x7f;
+
+    for (int shift = 7; true; shift += 7)
+    {
+      UKEY b = *pos++;
+      n |= (b & 0x7f) << shift;
+
+      if (b < 0x80)
+        return n;
+    }
+  }
+
+  // # of keys in block b:
+  size_t _blockKeys(size_t b) const
+  {
+    return (b + 1 < this->First.size()) ? BLOCK_KEYS : this->N - b * BLOCK_KEYS;
+  }
+
+  //
+  // the block that would hold u: the last one whose first key is
+  // not greater than u, or block 0:
+  //
+  size_t _findBlock(UKEY u) const
+  {
+    size_t lo = 0, hi = this->First.size();
+
+    while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+
+      if (u < this->First[mid])
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+    return (lo == 0) ? 0 : lo - 1;
+  }
+
+public:
+  //
+  // constructor:
+  //
+  // Builds the set from keys that are sorted and free of
+  // duplicates, e.g. the output of set::toVector().
+  //
+  compressed_set(const std::vector<TKey> &sorted)
+      : N(sorted.size())
+  {
+    UKEY prev = 0;
+
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+      UKEY u = _toUnsigned(sorted[i]);
+
+      if (i > 0 && u <= prev)
+        throw std::invalid_argument("compressed_set: keys must be sorted and distinct");
+
+      if (i % BLOCK_KEYS == 0)
+      {
+        this->First.push_back(u);
+        this->Offset.push_back(this->Data.size());
+      }
+      else
+        _putVarint(this->Data, u - prev);
+
+      prev = u;
+    }
+
+    this->Data.shrink_to_fit();
+  }
+
+  //
+  // size
+  //
+  // Returns # of elements in the set
+  //
+  int size() const
+  {
+    return (int)this->N;
+  }
+
+  //
+  // bytes
+  //
+  // Returns the # of bytes the set has allocated for its keys and
+  // skip index.
+  //
+  size_t bytes() const
+  {
+    return this->First.capacity() * sizeof(UKEY) + this->Offset.capacity() * sizeof(size_t) +
+           this->Data.capacity();
+  }
+
+  // #################################################################
+  //
+  // class iterator:
+  //
+  // Holds the current key, decoded, and where the next difference
+  // starts.
+  //
+  class iterator
+  {
+  private:
+    const compressed_set *Set;
+    size_t Block; // == # of blocks => end
+    size_t Index; // # of the current key in the block
+    const unsigned char *Pos;
+    UKEY U;
+
+    friend class compressed_set;
+
+    iterator(const compressed_set *set, size_t block)
+        : Set(set), Block(block), Index(0), Pos(nullptr), U(0)
+    {
+      if (this->Block < this->Set->First.size())
+      {
+        this->U = this->Set->First[this->Block];
+        this->Pos = this->Set->Data.data() + this->Set->Offset[this->Block];
+      }
+    }
+
+  public:
+    TKey operator*() const
+    {
+      if (this->Block >= this->Set->First.size())
+        throw std::out_of_range("compressed_set::iterator:operator*");
+
+      return _toKey(this->U);
+    }
+
+    bool operator==(const iterator &other) const
+    {
+      return this->Block == other.Block && this->Index == other.Index;
+    }
+
+    bool operator!=(const iterator &other) const
+    {
+      return !(*this == other);
+    }
+
+    void operator++()
+    {
+      if (this->Block >= this->Set->First.size())
+        return;
+
+      this->Index++;
+
+      if (this->Index < this->Set->_blockKeys(this->Block))
+        this->U += _getVarint(this->Pos);
+      else
+      { // first key of the next block, if any:
+        *this = iterator(this->Set, this->Block + 1);
+      }
+    }
+  };
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first key not less than key,
+  // or end() if there is none.
+  //
+  iterator lower_bound(TKey key) const
+  {
+    if (this->N == 0)
+      return this->end();
+
+    UKEY u = _toUnsigned(key);
+    iterator iter(this, _findBlock(u));
+
+    //
+    // decode the block up to the key; if every key in it is less,
+    // the answer is the first key of the next block:
+    //
+    while (iter.Block < this->First.size() && iter.U < u)
+      ++iter;
+
+    return iter;
+  }
+
+  //
+  // find:
+  //
+  // Returns an iterator denoting key, or end() if not found.
+  //
+  iterator find(TKey key) const
+  {
+    iterator iter = this->lower_bound(key);
+
+    if (iter != this->end() && iter.U == _toUnsigned(key))
+      return iter;
+    else
+      return this->end();
+  }
+
+  //
+  // contains
+  //
+  // Returns true if set contains key, false if not
+  //
+  bool contains(TKey key) const
+  {
+    return this->find(key) != this->end();
+  }
+
+  bool operator[](TKey key) const
+  {
+    return this->contains(key);
+  }
+
+  iterator begin() const
+  {
+    return iterator(this, 0);
+  }
+
+  iterator end() const
+  {
+    return iterator(this, this->First.size());
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order, in a vector.
+  //
+  std::vector<TKey> toVector() const
+  {
+    std::vector<TKey> V;
+    V.reserve(this->N);
+
+    for (iterator iter = this->begin(); iter != this->end(); ++iter)
+      V.push_back(*iter);
+
+    return V;
+  }
+};
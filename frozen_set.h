@@ -0,0 +1,487 @@
+/*frozen_set.h*/
+
+//
+// An immutable snapshot of a set, built for fast read-only lookup.
+// Produced by set::freeze().
+//
+// How the keys are arranged in memory is chosen by the Layout
+// template parameter:
+//
+//   eytzinger_layout -- BFS order of a complete search tree: the
+//     root is at position 1 and the children of i are at 2i and
+//     2i+1. The descent is branchless and, since the children of i
+//     are computed rather than loaded, a few levels ahead can be
+//     prefetched. This is the default.
+//
+//   veb_layout -- the same tree in van Emde Boas order: the top
+//     half of the levels is stored first, followed by each of the
+//     subtrees hanging below it, all laid out the same way
+//     recursively. A search touches O(log_B n) cache lines for any
+//     cache line size B, without tuning.
+//
+//   sorted_layout -- a plain sorted array with a branchless binary
+//     search, as the baseline.
+//
+// A layout maps "handles" to array slots. A handle is what the
+// iterator holds; 0 always means "no element". Each layout
+// provides:
+//
+//   init(n)                  prepares for n keys
+//   slots()                  # of array slots needed (>= n)
+//   lower_bound(keys, key)   handle of the first key >= key
+//   first(), next(h)         handles in sorted order
+//   slot(h)                  the array slot holding handle h
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>   // size_t
+#include <stdexcept>
+
+// #################################################################
+//
+// eytzinger_layout: handles are BFS positions 1..n, stored in slot
+// h - 1.
+//
+class eytzinger_layout
+{
+private:
+  size_t N;
+
+  //
+  // how far ahead to prefetch: position 16i is 4 levels below i,
+  // and its 16 descendants at that level are contiguous:
+  //
+  static const size_t PREFETCH_AHEAD = 16;
+
+public:
+  eytzinger_layout()
+      : N(0)
+  {
+  }
+
+  void init(size_t n) { this->N = n; }
+  size_t slots() const { return this->N; }
+  size_t slot(size_t h) const { return h - 1; }
+
+  template <typename TKey>
+  size_t lower_bound(const TKey *keys, const TKey &key) const
+  {
+    size_t i = 1;
+
+    while (i <= this->N)
+    {
+      size_t ahead = PREFETCH_AHEAD * i - 1;
+      __builtin_prefetch(keys + (ahead < this->N ? ahead : 0));
+
+      //
+      // go right if the key here is smaller, without a branch:
+      //
+      i = 2 * i + (size_t)(keys[i - 1] < key);
+    }
+
+    //
+    // i fell out of the tree; the answer is where we last went
+    // left, found by stripping the trailing right turns (1 bits)
+    // and the left turn (0 bit) before them:
+    //
+    i >>= __builtin_ffsll(~(unsigned long long)i);
+
+    return i;
+  }
+
+  size_t first() const
+  {
+    if (this->N == 0)
+      return 0;
+
+    size_t i = 1;
+    while (2 * i <= this->N)
+      i = 2 * i;
+
+    return i;
+  }
+
+  //
+  // the BFS position that follows i in sorted order, or 0:
+  //
+  size_t next(size_t i) const
+  {
+    if (2 * i + 1 <= this->N)
+    { // leftmost node of the right subtree:
+      i = 2 * i + 1;
+      while (2 * i <= this->N)
+        i = 2 * i;
+    }
+    else
+    { // go up past every right-child link, then once more:
+      while (i & 1)
+        i >>= 1;
+      i >>= 1;
+    }
+
+    return i;
+  }
+};
+
+// #################################################################
+//
+// veb_layout: handles are BFS positions 1..n of the same complete
+// tree as eytzinger_layout, but slots follow van Emde Boas order
+// for the perfect tree of the same height. Positions of that
+// perfect tree past n are left as unused slots, so up to 2x the
+// slots may be allocated.
+//
+// Slots are found with the tables of Brodal, Fagerberg and Jacob:
+// every depth d >= 1 is the depth of the roots of the bottom trees
+// at exactly one level of the recursion, and for a node i there
+//
+//   slot(i) = slot(ancestor of i at depth Top)
+//             + TopSize + (i & TopSize) * BottomSize
+//
+// i.e. skip the top tree, then skip the bottom trees to the left
+// of the one rooted at i; (i & TopSize) is the path taken from the
+// top tree's root, which numbers those bottom trees.
+//
+class veb_layout
+{
+private:
+  struct LEVEL
+  {
+    size_t Top;        // depth of the enclosing top tree's root
+    size_t TopSize;    // # of nodes in that top tree
+    size_t BottomSize; // # of nodes in each bottom tree
+  };
+
+  size_t N;
+  int Height;                // # of levels
+  std::vector<LEVEL> Levels; // indexed by depth
+
+  void _split(int lo, int hi)
+  {
+    int h = hi - lo;
+    if (h <= 1)
+      return;
+
+    int top = h / 2;
+    int d = lo + top;
+
+    this->Levels[d].Top = lo;
+    this->Levels[d].TopSize = (size_t(1) << top) - 1;
+    this->Levels[d].BottomSize = (size_t(1) << (h - top)) - 1;
+
+    _split(lo, d);
+    _split(d, hi);
+  }
+
+  static int _depth(size_t i)
+  {
+    return 63 - __builtin_clzll((unsigned long long)i);
+  }
+
+public:
+  veb_layout()
+      : N(0), Height(0)
+  {
+  }
+
+  void init(size_t n)
+  {
+    this->N = n;
+    this->Height = (n == 0) ? 0 : _depth(n) + 1;
+
+    this->Levels.assign(this->Height + 1, LEVEL{0, 0, 0});
+
+    _split(0, this->Height);
+  }
+
+  size_t slots() const
+  {
+    return (this->Height == 0) ? 0 : (size_t(1) << this->Height) - 1;
+  }
+
+  size_t slot(size_t i) const
+  {
+    int d = _depth(i);
+    if (d == 0)
+      return 0;
+
+    const LEVEL &L = this->Levels[d];
+
+    return slot(i >> (d - L.Top)) + L.TopSize + (i & L.TopSize) * L.BottomSize;
+  }
+
+  template <typename TKey>
+  size_t lower_bound(const TKey *keys, const TKey &key) const
+  {
+    size_t pos[64]; // slot of the node visited at each depth
+    size_t i = 1;
+    int d = 0;
+
+    pos[0] = 0;
+
+    while (i <= this->N)
+    {
+      i = 2 * i + (size_t)(keys[pos[d]] < key);
+      d++;
+
+      if (d < this->Height)
+      {
+        const LEVEL &L = this->Levels[d];
+        pos[d] = pos[L.Top] + L.TopSize + (i & L.TopSize) * L.BottomSize;
+      }
+    }
+
+    i >>= __builtin_ffsll(~(unsigned long long)i);
+
+    return i;
+  }
+
+  //
+  // in-order walk over BFS positions, as in eytzinger_layout:
+  //
+  size_t first() const
+  {
+    if (this->N == 0)
+      return 0;
+
+    size_t i = 1;
+    while (2 * i <= this->N)
+      i = 2 * i;
+
+    return i;
+  }
+
+  size_t next(size_t i) const
+  {
+    if (2 * i + 1 <= this->N)
+    {
+      i = 2 * i + 1;
+      while (2 * i <= this->N)
+        i = 2 * i;
+    }
+    else
+    {
+      while (i & 1)
+        i >>= 1;
+      i >>= 1;
+    }
+
+    return i;
+  }
+};
+
+// #################################################################
+//
+// sorted_layout: handles are 1 + the index into the sorted array.
+//
+class sorted_layout
+{
+private:
+  size_t N;
+
+public:
+  sorted_layout()
+      : N(0)
+  {
+  }
+
+  void init(size_t n) { this->N = n; }
+  size_t slots() const { return this->N; }
+  size_t slot(size_t h) const { return h - 1; }
+
+  template <typename TKey>
+  size_t lower_bound(const TKey *keys, const TKey &key) const
+  {
+    if (this->N == 0)
+      return 0;
+
+    //
+    // branchless binary search: base only moves forward, by half
+    // of what is left each time:
+    //
+    const TKey *base = keys;
+    size_t len = this->N;
+
+    while (len > 1)
+    {
+      size_t half = len / 2;
+      base += half * (size_t)(base[half - 1] < key);
+      len -= half;
+    }
+
+    size_t index = (base - keys) + (size_t)(*base < key);
+
+    return (index == this->N) ? 0 : index + 1;
+  }
+
+  size_t first() const { return (this->N == 0) ? 0 : 1; }
+  size_t next(size_t h) const { return (h < this->N) ? h + 1 : 0; }
+};
+
+// #################################################################
+//
+// frozen_set:
+//
+template <typename TKey, typename Layout = eytzinger_layout>
+class frozen_set
+{
+private:
+  std::vector<TKey> Keys; // indexed by slot
+  Layout L;
+  size_t N;
+
+public:
+  //
+  // constructor:
+  //
+  // Builds the layout from keys that are sorted and free of
+  // duplicates, e.g. the output of set::toVector().
+  //
+  frozen_set(const std::vector<TKey> &sorted)
+      : N(sorted.size())
+  {
+    this->L.init(this->N);
+
+    //
+    // walk the handles in sorted order to find which key goes in
+    // each slot; unused slots repeat the largest key:
+    //
+    std::vector<size_t> RankOf(this->L.slots(), this->N);
+    size_t rank = 0;
+
+    for (size_t h = this->L.first(); h != 0; h = this->L.next(h))
+      RankOf[this->L.slot(h)] = rank++;
+
+    this->Keys.reserve(RankOf.size());
+    for (size_t r : RankOf)
+      this->Keys.push_back(sorted[(r < this->N) ? r : this->N - 1]);
+  }
+
+  //
+  // size
+  //
+  // Returns # of elements in the set
+  //
+  int size() const
+  {
+    return (int)this->N;
+  }
+
+  //
+  // contains
+  //
+  // Returns true if set contains key, false if not
+  //
+  bool contains(TKey key) const
+  {
+    size_t h = this->L.lower_bound(this->Keys.data(), key);
+
+    return h != 0 && !(key < this->Keys[this->L.slot(h)]);
+  }
+
+  bool operator[](TKey key) const
+  {
+    return this->contains(key);
+  }
+
+  // #################################################################
+  //
+  // class iterator:
+  //
+  // Visits the keys in sorted order, following the layout's
+  // handles.
+  //
+  class iterator
+  {
+  private:
+    const frozen_set *Set;
+    size_t H; // handle, 0 => end
+
+  public:
+    iterator(const frozen_set *set, size_t h)
+        : Set(set), H(h)
+    {
+    }
+
+    TKey operator*() const
+    {
+      if (this->H == 0)
+        throw std::out_of_range("frozen_set::iterator:operator*");
+
+      return this->Set->Keys[this->Set->L.slot(this->H)];
+    }
+
+    bool operator==(const iterator &other) const
+    {
+      return this->H == other.H;
+    }
+
+    bool operator!=(const iterator &other) const
+    {
+      return this->H != other.H;
+    }
+
+    void operator++()
+    {
+      if (this->H != 0)
+        this->H = this->Set->L.next(this->H);
+    }
+  };
+
+  //
+  // find:
+  //
+  // Returns an iterator denoting key, or end() if not found.
+  //
+  iterator find(TKey key) const
+  {
+    size_t h = this->L.lower_bound(this->Keys.data(), key);
+
+    if (h != 0 && !(key < this->Keys[this->L.slot(h)]))
+      return iterator(this, h);
+    else
+      return this->end();
+  }
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first key not less than key,
+  // or end() if there is none.
+  //
+  iterator lower_bound(TKey key) const
+  {
+    return iterator(this, this->L.lower_bound(this->Keys.data(), key));
+  }
+
+  iterator begin() const
+  {
+    return iterator(this, this->L.first());
+  }
+
+  iterator end() const
+  {
+    return iterator(this, 0);
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order, in a vector.
+  //
+  std::vector<TKey> toVector() const
+  {
+    std::vector<TKey> V;
+    V.reserve(this->N);
+
+    for (iterator iter = this->begin(); iter != this->end(); ++iter)
+      V.push_back(*iter);
+
+    return V;
+  }
+};
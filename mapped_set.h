@@ -0,0 +1,407 @@
+/*mapped_set.h*/
+
+//
+// A frozen_set kept in a file and read in place with mmap, so that
+// many processes can share one read-only set, loaded once into the
+// page cache, with no copy per process.
+//
+// mapped_set<TKey, Layout>::write(path, S.toVector()) writes the
+// keys of a set S in one of the layouts of frozen_set.h (Eytzinger
+// by default), the same arrangement S.freeze() builds in memory; the
+// constructor then maps the file and answers contains, find,
+// lower_bound and iteration straight from the mapping. Opening a
+// file costs an mmap and a check of its header, whatever its size;
+// pages are read in as lookups touch them.
+//
+// The file holds the keys' bytes as they are in memory, so TKey
+// must be trivially copyable (no std::string), and a file is only
+// readable on machines with the same byte order and type sizes.
+// The file is
+//
+//   HEADER (64 bytes), then the key in each slot of the layout
+//
+// The header records the key size, the kind of key (as set_codec
+// names it: signed, unsigned, floating or custom) and the layout,
+// and the constructor throws std::runtime_error if they don't match,
+// so e.g. a file written from mapped_set<int> is not read as floats.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring> // std::memcmp
+#include <cstdio>  // std::rename, std::remove
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>  // open
+#include <stdlib.h> // mkstemp
+#include <unistd.h> // fsync
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frozen_set.h"
+#include "set_codec.h" // set_fd_sink
+
+//
+// the layout a file was written in is recorded by number:
+//
+template <typename Layout>
+struct mapped_set_layout;
+
+template <>
+struct mapped_set_layout<eytzinger_layout>
+{
+  static const unsigned id = 1;
+};
+
+template <>
+struct mapped_set_layout<veb_layout>
+{
+  static const unsigned id = 2;
+};
+
+template <>
+struct mapped_set_layout<sorted_layout>
+{
+  static const unsigned id = 3;
+};
+
+//
+// the kind of key, as set_codec gives it, or custom for key types
+// it has no codec for:
+//
+template <typename TKey, bool = set_codec<TKey>::enabled>
+struct mapped_set_kind
+{
+  static constexpr set_codec_kind kind = set_codec_kind::custom;
+};
+
+template <typename TKey>
+struct mapped_set_kind<TKey, true>
+{
+  static constexpr set_codec_kind kind = set_codec<TKey>::kind;
+};
+
+template <typename TKey, typename Layout = eytzinger_layout>
+class mapped_set
+{
+  static_assert(std::is_trivially_copyable<TKey>::value, "mapped_set: TKey must be trivially copyable");
+
+private:
+  struct HEADER
+  {
+    char Magic[8];        // "TBSTMAP2"; 2 added KeyKind
+    unsigned KeySize;     // sizeof(TKey)
+    unsigned LayoutId;    // mapped_set_layout<Layout>::id
+    unsigned long long N; // # of keys
+    unsigned long long Slots;
+    unsigned KeyKind; // mapped_set_kind<TKey>::kind
+    char Unused[28];  // keeps the keys 64-byte aligned
+  };
+
+  static_assert(sizeof(HEADER) == 64, "mapped_set: HEADER must be 64 bytes");
+
+  void *Map; // the whole file
+  size_t MapBytes;
+  const TKey *Keys; // indexed by slot, right after the header
+  Layout L;
+  size_t N;
+
+  static void _fail(const std::string &path, const char *what)
+  {
+    throw std::runtime_error("mapped_set: " + path + ": " + what);
+  }
+
+public:
+  //
+  // write
+  //
+  // Writes keys that are sorted and free of duplicates, e.g. the
+  // output of set::toVector(), to a file at path. The file is
+  // written under a unique temporary name next to path (so that
+  // concurrent writers don't clobber each other), flushed to disk,
+  // and renamed into place, so a process opening path sees either
+  // the old file or the new one, even after a crash, and sets
+  // mapped from the old file stay as they were.
+  //
+  static void write(const std::string &path, const std::vector<TKey> &sorted)
+  {
+    Layout layout;
+    size_t n = sorted.size();
+    layout.init(n);
+
+    //
+    // as frozen_set does: the rank of the key in each slot, with
+    // unused slots repeating the largest key:
+    //
+    std::vector<size_t> RankOf(layout.slots(), n);
+    size_t rank = 0;
+
+    for (size_t h = layout.first(); h != 0; h = layout.next(h))
+      RankOf[layout.slot(h)] = rank++;
+
+    HEADER header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.Magic, "TBSTMAP2", 8);
+    header.KeySize = sizeof(TKey);
+    header.KeyKind = (unsigned)mapped_set_kind<TKey>::kind;
+    header.LayoutId = mapped_set_layout<Layout>::id;
+    header.N = n;
+    header.Slots = RankOf.size();
+
+    std::string temp = path + ".XXXXXX";
+    int fd = ::mkstemp(&temp[0]);
+
+    if (fd < 0)
+      _fail(temp, "cannot create");
+
+    //
+    // mkstemp creates the file 0600; give it the mode open() would,
+    // 0666 less the umask (which can only be read by setting it):
+    //
+    mode_t mask = ::umask(0);
+    ::umask(mask);
+
+    try
+    {
+      if (::fchmod(fd, 0666 & ~mask) != 0)
+        _fail(temp, "cannot create");
+
+      set_fd_sink sink{fd};
+      sink.write((const char *)&header, sizeof(header));
+
+      std::vector<TKey> buffer;
+      buffer.reserve(65536);
+
+      for (size_t r : RankOf)
+      {
+        buffer.push_back(sorted[(r < n) ? r : n - 1]);
+
+        if (buffer.size() == 65536)
+        {
+          sink.write((const char *)buffer.data(), buffer.size() * sizeof(TKey));
+          buffer.clear();
+        }
+      }
+
+      sink.write((const char *)buffer.data(), buffer.size() * sizeof(TKey));
+
+      if (::fsync(fd) != 0)
+        _fail(temp, "cannot write");
+    }
+    catch (...)
+    {
+      ::close(fd);
+      std::remove(temp.c_str());
+      throw;
+    }
+
+    if (::close(fd) != 0 || std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+      std::remove(temp.c_str());
+      _fail(path, "cannot write");
+    }
+  }
+
+  //
+  // constructor:
+  //
+  // Maps the file at path, written by write() with the same TKey
+  // and Layout.
+  //
+  mapped_set(const std::string &path)
+      : Map(nullptr), MapBytes(0), Keys(nullptr), N(0)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+      _fail(path, "cannot open");
+
+    struct stat info;
+
+    if (::fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(HEADER))
+    {
+      ::close(fd);
+      _fail(path, "not a mapped set");
+    }
+
+    this->MapBytes = info.st_size;
+    this->Map = ::mmap(nullptr, this->MapBytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file
+
+    if (this->Map == MAP_FAILED)
+    {
+      this->Map = nullptr;
+      _fail(path, "cannot map");
+    }
+
+    const HEADER *header = (const HEADER *)this->Map;
+    const char *problem = nullptr;
+
+    if (std::memcmp(header->Magic, "TBSTMAP2", 8) != 0)
+      problem = "not a mapped set";
+    else if (header->KeySize != sizeof(TKey) || header->KeyKind != (unsigned)mapped_set_kind<TKey>::kind)
+      problem = "written with a different key type";
+    else if (header->LayoutId != mapped_set_layout<Layout>::id)
+      problem = "written with a different layout";
+    else if (header->N > header->Slots || header->Slots != (this->MapBytes - sizeof(HEADER)) / sizeof(TKey))
+      problem = "wrong size";
+    else
+    {
+      this->N = header->N;
+      this->L.init(this->N);
+
+      if (header->Slots != this->L.slots() || this->MapBytes != sizeof(HEADER) + header->Slots * sizeof(TKey))
+        problem = "wrong size";
+    }
+
+    if (problem != nullptr)
+    {
+      ::munmap(this->Map, this->MapBytes);
+      this->Map = nullptr;
+      _fail(path, problem);
+    }
+
+    this->Keys = (const TKey *)((const char *)this->Map + sizeof(HEADER));
+  }
+
+  mapped_set(const mapped_set &other) = delete;
+  mapped_set &operator=(const mapped_set &other) = delete;
+
+  //
+  // destructor:
+  //
+  ~mapped_set()
+  {
+    if (this->Map != nullptr)
+      ::munmap(this->Map, this->MapBytes);
+  }
+
+  //
+  // size
+  //
+  // Returns # of elements in the set
+  //
+  int size() const
+  {
+    return (int)this->N;
+  }
+
+  //
+  // contains
+  //
+  // Returns true if set contains key, false if not
+  //
+  bool contains(TKey key) const
+  {
+    size_t h = this->L.lower_bound(this->Keys, key);
+
+    return h != 0 && !(key < this->Keys[this->L.slot(h)]);
+  }
+
+  bool operator[](TKey key) const
+  {
+    return this->contains(key);
+  }
+
+  // #################################################################
+  //
+  // class iterator:
+  //
+  // Visits the keys in sorted order, following the layout's
+  // handles, as frozen_set's iterator does.
+  //
+  class iterator
+  {
+  private:
+    const mapped_set *Set;
+    size_t H; // handle, 0 => end
+
+  public:
+    iterator(const mapped_set *set, size_t h)
+        : Set(set), H(h)
+    {
+    }
+
+    TKey operator*() const
+    {
+      if (this->H == 0)
+        throw std::out_of_range("mapped_set::iterator:operator*");
+
+      return this->Set->Keys[this->Set->L.slot(this->H)];
+    }
+
+    bool operator==(const iterator &other) const
+    {
+      return this->H == other.H;
+    }
+
+    bool operator!=(const iterator &other) const
+    {
+      return this->H != other.H;
+    }
+
+    void operator++()
+    {
+      if (this->H != 0)
+        this->H = this->Set->L.next(this->H);
+    }
+  };
+
+  //
+  // find:
+  //
+  // Returns an iterator denoting key, or end() if not found.
+  //
+  iterator find(TKey key) const
+  {
+    size_t h = this->L.lower_bound(this->Keys, key);
+
+    if (h != 0 && !(key < this->Keys[this->L.slot(h)]))
+      return iterator(this, h);
+    else
+      return this->end();
+  }
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first key not less than key,
+  // or end() if there is none.
+  //
+  iterator lower_bound(TKey key) const
+  {
+    return iterator(this, this->L.lower_bound(this->Keys, key));
+  }
+
+  iterator begin() const
+  {
+    return iterator(this, this->L.first());
+  }
+
+  iterator end() const
+  {
+    return iterator(this, 0);
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order, in a vector.
+  //
+  std::vector<TKey> toVector() const
+  {
+    std::vector<TKey> V;
+    V.reserve(this->N);
+
+    for (iterator iter = this->begin(); iter != this->end(); ++iter)
+      V.push_back(*iter);
+
+    return V;
+  }
+};
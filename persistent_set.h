@@ -0,0 +1,477 @@
+/*persistent_set.h*/
+
+//
+// A set whose copies share structure: copying is O(1), and an
+// insert or erase copies only the nodes on the path it changes,
+// O(log n) expected, leaving every other copy as it was. Offers the
+// interface of set (insert, contains, [], find, lower_bound,
+// begin/end, toVector, size) plus erase.
+//
+// Nodes are immutable and reference counted (std::shared_ptr), and
+// a set is just a pointer to its root. A node reachable from two
+// versions of the set cannot hold a thread, since its successor
+// may differ between them, so there are no threads here. Instead
+// the iterator keeps the path from the root to the current node on
+// a stack and recomputes the successor on the fly, O(1) amortized.
+//
+// To keep paths short the tree is a treap with priorities hashed
+// from the keys (as set_balance::treap does in set.h), so TKey
+// needs std::hash as well as operator<.
+//
+// One persistent_set may be shared between threads: the root is
+// only read and replaced with the atomic shared_ptr operations, so
+// any thread may take a snapshot() (or iterate, or look up) while
+// others insert or erase. A writer builds its new version off to
+// the side and publishes it with a compare-and-swap, retrying if
+// another writer got there first. A version is freed when the last
+// snapshot or iterator holding it goes away.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <memory> // std::shared_ptr, std::atomic_load
+#include <vector>
+#include <stdexcept>
+
+#include "set_hash.h"
+
+template <typename TKey>
+class persistent_set
+{
+  static_assert(set_hashable<TKey>::value, "persistent_set: std::hash<TKey> is required");
+
+private:
+  // #################################################################
+  //
+  // nodes:
+  //
+  struct NODE;
+  typedef std::shared_ptr<const NODE> PTR;
+
+  struct NODE
+  {
+    TKey Key;
+    unsigned long long Priority; // never less than the children's
+    int Count;                   // # of nodes in this subtree
+    PTR Left;
+    PTR Right;
+
+    NODE(const TKey &key, unsigned long long priority, PTR left, PTR right)
+        : Key(key), Priority(priority), Count(1 + _count(left) + _count(right)),
+          Left(std::move(left)), Right(std::move(right))
+    {
+    }
+  };
+
+  PTR Root; // nullptr when empty; see _root()
+
+  // the current version, safe against a concurrent writer:
+  PTR _root() const
+  {
+    return std::atomic_load(&this->Root);
+  }
+
+  static int _count(const PTR &cur)
+  {
+    return (cur == nullptr) ? 0 : cur->Count;
+  }
+
+  static PTR _make(const TKey &key, unsigned long long priority, PTR left, PTR right)
+  {
+    return std::make_shared<const NODE>(key, priority, std::move(left), std::move(right));
+  }
+
+  // a copy of n with new children:
+  static PTR _make(const PTR &n, PTR left, PTR right)
+  {
+    return _make(n->Key, n->Priority, std::move(left), std::move(right));
+  }
+
+  //
+  // _insert
+  //
+  // Returns the root of cur's subtree with key added, copying the
+  // nodes on the path to it; returns cur itself if key is already
+  // there. The new node is rotated up past parents of lower
+  // priority on the way back.
+  //
+  static PTR _insert(const PTR &cur, const TKey &key, unsigned long long priority)
+  {
+    if (cur == nullptr)
+      return _make(key, priority, nullptr, nullptr);
+
+    if (key < cur->Key)
+    {
+      PTR left = _insert(cur->Left, key, priority);
+
+      if (left == cur->Left)
+        return cur;
+
+      if (cur->Priority < left->Priority) // rotate right:
+        return _make(left, left->Left, _make(cur, left->Right, cur->Right));
+      else
+        return _make(cur, left, cur->Right);
+    }
+    else if (cur->Key < key)
+    {
+      PTR right = _insert(cur->Right, key, priority);
+
+      if (right == cur->Right)
+        return cur;
+
+      if (cur->Priority < right->Priority) // rotate left:
+        return _make(right, _make(cur, cur->Left, right->Left), right->Right);
+      else
+        return _make(cur, cur->Left, right);
+    }
+    else
+      return cur; // already present
+  }
+
+  //
+  // _join
+  //
+  // Joins two treaps, every key of a less than every key of b, by
+  // merging a's right spine with b's left spine.
+  //
+  static PTR _join(const PTR &a, const PTR &b)
+  {
+    if (a == nullptr)
+      return b;
+    else if (b == nullptr)
+      return a;
+
+    if (b->Priority < a->Priority)
+      return _make(a, a->Left, _join(a->Right, b));
+    else
+      return _make(b, _join(a, b->Left), b->Right);
+  }
+
+  static PTR _erase(const PTR &cur, const TKey &key)
+  {
+    if (cur == nullptr)
+      return cur;
+
+    if (key < cur->Key)
+    {
+      PTR left = _erase(cur->Left, key);
+      return (left == cur->Left) ? cur : _make(cur, left, cur->Right);
+    }
+    else if (cur->Key < key)
+    {
+      PTR right = _erase(cur->Right, key);
+      return (right == cur->Right) ? cur : _make(cur, cur->Left, right);
+    }
+    else // drop cur, its subtrees take its place:
+      return _join(cur->Left, cur->Right);
+  }
+
+  // sets Count in a subtree that was linked after its nodes were made:
+  static int _recount(NODE *cur)
+  {
+    if (cur == nullptr)
+      return 0;
+
+    cur->Count = 1 + _recount(const_cast<NODE *>(cur->Left.get())) + _recount(const_cast<NODE *>(cur->Right.get()));
+
+    return cur->Count;
+  }
+
+  static const NODE *_find(const NODE *cur, const TKey &key)
+  {
+    while (cur != nullptr)
+    {
+      if (key < cur->Key)
+        cur = cur->Left.get();
+      else if (cur->Key < key)
+        cur = cur->Right.get();
+      else
+        return cur;
+    }
+
+    return nullptr;
+  }
+
+public:
+  //
+  // default constructor:
+  //
+  persistent_set()
+  {
+  }
+
+  //
+  // constructor:
+  //
+  // Builds the set from keys that are sorted and free of
+  // duplicates, e.g. the output of set::toVector(), in O(n): the
+  // right spine of the treap built so far is kept on a stack, and
+  // each new (largest) key goes at the bottom of it, taking the
+  // keys of lower priority it pops as its left subtree. The nodes
+  // are only frozen once the whole tree is linked.
+  //
+  persistent_set(const std::vector<TKey> &sorted)
+  {
+    std::vector<std::shared_ptr<NODE>> spine;
+
+    for (const TKey &key : sorted)
+    {
+      std::shared_ptr<NODE> n = std::make_shared<NODE>(key, set_hash(key), nullptr, nullptr);
+      std::shared_ptr<NODE> popped;
+
+      while (!spine.empty() && spine.back()->Priority < n->Priority)
+      {
+        popped = spine.back();
+        spine.pop_back();
+      }
+
+      n->Left = popped;
+
+      if (!spine.empty())
+        spine.back()->Right = n;
+
+      spine.push_back(n);
+    }
+
+    if (!spine.empty())
+    {
+      _recount(spine.front().get());
+      this->Root = spine.front();
+    }
+  }
+
+  //
+  // copy constructor / assignment: O(1), the copies share every
+  // node until one of them changes.
+  //
+  persistent_set(const persistent_set &other)
+      : Root(other._root())
+  {
+  }
+
+  persistent_set &operator=(const persistent_set &other)
+  {
+    std::atomic_store(&this->Root, other._root());
+
+    return *this;
+  }
+
+  //
+  // snapshot
+  //
+  // Returns the current version of the set, which stays as it is
+  // while this set goes on changing; O(1). Safe to call while other
+  // threads insert into or erase from this set.
+  //
+  persistent_set snapshot() const
+  {
+    return *this;
+  }
+
+  //
+  // size
+  //
+  // Returns # of elements in the set
+  //
+  int size() const
+  {
+    return _count(this->_root());
+  }
+
+  //
+  // contains
+  //
+  // Returns true if set contains key, false if not
+  //
+  bool contains(const TKey &key) const
+  {
+    PTR root = this->_root();
+
+    return _find(root.get(), key) != nullptr;
+  }
+
+  bool operator[](const TKey &key) const
+  {
+    return this->contains(key);
+  }
+
+  //
+  // insert
+  //
+  // Inserts the given key into the set; if the key is already in
+  // the set then this function has no effect. Other copies of the
+  // set do not see the key.
+  //
+  void insert(const TKey &key)
+  {
+    unsigned long long priority = set_hash(key);
+    PTR root = this->_root();
+
+    while (true)
+    {
+      PTR updated = _insert(root, key, priority);
+
+      if (updated == root) // already present
+        return;
+
+      // on failure root is reloaded with the version that won:
+      if (std::atomic_compare_exchange_weak(&this->Root, &root, updated))
+        return;
+    }
+  }
+
+  //
+  // erase
+  //
+  // Removes key from the set, if present, and returns the # of
+  // keys removed (0 or 1). Other copies of the set keep it.
+  //
+  int erase(const TKey &key)
+  {
+    PTR root = this->_root();
+
+    while (true)
+    {
+      PTR updated = _erase(root, key);
+
+      if (updated == root) // not present
+        return 0;
+
+      if (std::atomic_compare_exchange_weak(&this->Root, &root, updated))
+        return 1;
+    }
+  }
+
+  // #################################################################
+  //
+  // class iterator:
+  //
+  // Holds the version it iterates (so it stays alive) and a stack
+  // holding the current node and every ancestor whose key is still
+  // to come, i.e. where the path went left. ++ pops the current
+  // node and pushes the leftmost path of its right subtree.
+  //
+  class iterator
+  {
+  private:
+    PTR Root;
+    std::vector<const NODE *> Stack; // empty => end
+
+    friend class persistent_set;
+
+    void _pushLeft(const NODE *cur)
+    {
+      for (; cur != nullptr; cur = cur->Left.get())
+        this->Stack.push_back(cur);
+    }
+
+  public:
+    TKey operator*() const
+    {
+      if (this->Stack.empty())
+        throw std::out_of_range("persistent_set::iterator:operator*");
+
+      return this->Stack.back()->Key;
+    }
+
+    bool operator==(const iterator &other) const
+    {
+      if (this->Stack.empty() || other.Stack.empty())
+        return this->Stack.empty() == other.Stack.empty();
+
+      return this->Stack.back() == other.Stack.back();
+    }
+
+    bool operator!=(const iterator &other) const
+    {
+      return !(*this == other);
+    }
+
+    void operator++()
+    {
+      if (this->Stack.empty())
+        return;
+
+      const NODE *cur = this->Stack.back();
+      this->Stack.pop_back();
+
+      _pushLeft(cur->Right.get());
+    }
+  };
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first element that is not
+  // less than key, or end() if there is no such element.
+  //
+  iterator lower_bound(const TKey &key) const
+  {
+    iterator iter;
+    iter.Root = this->_root();
+
+    for (const NODE *cur = iter.Root.get(); cur != nullptr;)
+    {
+      if (cur->Key < key)
+        cur = cur->Right.get();
+      else
+      { // cur is a candidate, look for a smaller one:
+        iter.Stack.push_back(cur);
+        cur = cur->Left.get();
+      }
+    }
+
+    return iter;
+  }
+
+  //
+  // find:
+  //
+  // If the set contains key, then an iterator denoting this
+  // element is returned. If the set does not contain key,
+  // then set.end() is returned.
+  //
+  iterator find(const TKey &key) const
+  {
+    iterator iter = this->lower_bound(key);
+
+    if (!iter.Stack.empty() && key < iter.Stack.back()->Key)
+      return this->end();
+
+    return iter;
+  }
+
+  iterator begin() const
+  {
+    iterator iter;
+    iter.Root = this->_root();
+    iter._pushLeft(iter.Root.get());
+
+    return iter;
+  }
+
+  iterator end() const
+  {
+    return iterator();
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order, in a vector.
+  //
+  std::vector<TKey> toVector() const
+  {
+    persistent_set version = this->snapshot();
+    std::vector<TKey> V;
+    V.reserve(version.size());
+
+    for (iterator iter = version.begin(); iter != version.end(); ++iter)
+      V.push_back(*iter);
+
+    return V;
+  }
+};
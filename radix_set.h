@@ -0,0 +1,529 @@
+/*radix_set.h*/
+
+//
+// A set of integers, stored as a radix tree of 64-bit bitmaps.
+// Offers the same interface as set (insert, contains, [], find,
+// lower_bound, begin/end, toVector, size, for_each) so it can be
+// used in place of it.
+//
+// A key is read as a string of 6-bit digits, most significant
+// first, and each node of the tree covers one digit: bit d of a
+// node's Bits is set if any key continues with digit d. An inner
+// node keeps only the children that exist, in digit order, so the
+// child for digit d is at the # of set bits below bit d. The last
+// level holds no children; its bits are the keys themselves, 64
+// consecutive keys to a word.
+//
+// The depth is fixed by the key width: 6 levels for 32-bit keys and
+// 11 for 64-bit keys, however many keys there are. lower_bound and
+// the iterator's ++ find the next set bit in a word with a single
+// count-trailing-zeros instruction, and ++ usually stays within the
+// same last-level word, so a scan is a walk over bitmaps rather
+// than over nodes. Dense keys take well under a byte each.
+//
+// fast_set<TKey> (at the end of this file) is radix_set<TKey> for
+// integral keys other than bool, and set<TKey> for all others.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <utility> // std::swap
+
+#include "set.h"
+
+template <typename TKey>
+class radix_set
+{
+  static_assert(std::is_integral<TKey>::value, "radix_set: TKey must be an integral type");
+
+private:
+  // #################################################################
+  //
+  // digits:
+  //
+  // Keys are mapped to unsigned values of the same width, flipping
+  // the sign bit of signed types so negative keys order first.
+  //
+  typedef unsigned long long UKEY;
+
+  static const int BITS = 8 * sizeof(TKey);
+  static const int LEVELS = (BITS + 5) / 6;
+
+  static UKEY _toUnsigned(TKey key)
+  {
+    UKEY u = (UKEY)(typename std::make_unsigned<TKey>::type)key;
+
+    if (std::is_signed<TKey>::value)
+      u ^= (UKEY)1 << (BITS - 1);
+
+    return u;
+  }
+
+  static TKey _toKey(UKEY u)
+  {
+    if (std::is_signed<TKey>::value)
+      u ^= (UKEY)1 << (BITS - 1);
+
+    return (TKey)u;
+  }
+
+  static int _shift(int level)
+  {
+    return 6 * (LEVELS - 1 - level);
+  }
+
+  static int _digit(UKEY u, int level)
+  {
+    return (int)((u >> _shift(level)) & 63);
+  }
+
+  // u with the digit at level and every digit below it cleared:
+  static UKEY _prefix(UKEY u, int level)
+  {
+    int low = _shift(level) + 6;
+
+    return (low >= 64) ? 0 : u & ~(((UKEY)1 << low) - 1);
+  }
+
+  // #################################################################
+  //
+  // nodes:
+  //
+  struct NODE
+  {
+    unsigned long long Bits;     // digits present
+    std::vector<NODE *> Children; // one per set bit, empty at the last level
+
+    NODE()
+        : Bits(0)
+    {
+    }
+  };
+
+  NODE *Root; // nullptr when empty
+  int Size;   // # of keys
+
+  // the child for digit d, which must be present:
+  static NODE *_child(NODE *cur, int d)
+  {
+    return cur->Children[__builtin_popcountll(cur->Bits & ((1ULL << d) - 1))];
+  }
+
+  //
+  // _descendMin
+  //
+  // Takes digit d at path[level], then the smallest digit at every
+  // level below, filling in path; returns the key reached. prefix
+  // holds the digits above level.
+  //
+  static UKEY _descendMin(NODE **path, int level, int d, UKEY prefix)
+  {
+    while (true)
+    {
+      prefix |= (UKEY)d << _shift(level);
+
+      if (level == LEVELS - 1)
+        return prefix;
+
+      path[level + 1] = _child(path[level], d);
+      level++;
+      d = __builtin_ctzll(path[level]->Bits);
+    }
+  }
+
+  //
+  // _upFrom
+  //
+  // Finds the smallest key greater than u among the subtrees to the
+  // right of u's path, starting at level and working up. path holds
+  // u's path down to level. Returns false if there is none.
+  //
+  static bool _upFrom(NODE **path, int level, UKEY u, UKEY &result)
+  {
+    for (; level >= 0; level--)
+    {
+      int d = _digit(u, level);
+      unsigned long long higher = (d == 63) ? 0 : path[level]->Bits & (~0ULL << (d + 1));
+
+      if (higher != 0)
+      {
+        result = _descendMin(path, level, __builtin_ctzll(higher), _prefix(u, level));
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  //
+  // _seek
+  //
+  // Finds the first key not less than u, filling in its path.
+  // Returns false if there is none.
+  //
+  bool _seek(UKEY u, NODE **path, UKEY &result)
+  {
+    if (this->Root == nullptr)
+      return false;
+
+    path[0] = this->Root;
+
+    for (int level = 0;; level++)
+    {
+      int d = _digit(u, level);
+
+      if (((path[level]->Bits >> d) & 1) == 0) // u isn't here, the answer is to the right:
+        return _upFrom(path, level, u, result);
+
+      if (level == LEVELS - 1)
+      {
+        result = u;
+        return true;
+      }
+
+      path[level + 1] = _child(path[level], d);
+    }
+  }
+
+  static void _destroy(NODE *cur)
+  {
+    if (cur == nullptr)
+      return;
+
+    for (NODE *child : cur->Children)
+      _destroy(child);
+
+    delete cur;
+  }
+
+  static NODE *_copy(NODE *cur)
+  {
+    if (cur == nullptr)
+      return nullptr;
+
+    NODE *n = new NODE();
+    n->Bits = cur->Bits;
+
+    for (NODE *child : cur->Children)
+      n->Children.push_back(_copy(child));
+
+    return n;
+  }
+
+  template <typename F>
+  static void _forEach(NODE *cur, int level, UKEY prefix, F &f)
+  {
+    if (level == LEVELS - 1)
+    {
+      //
+      // one call per set bit, lowest first:
+      //
+      for (unsigned long long bits = cur->Bits; bits != 0; bits &= bits - 1)
+        f(_toKey(prefix | (UKEY)__builtin_ctzll(bits)));
+
+      return;
+    }
+
+    int i = 0;
+
+    for (unsigned long long bits = cur->Bits; bits != 0; bits &= bits - 1)
+    {
+      UKEY d = __builtin_ctzll(bits);
+      _forEach(cur->Children[i++], level + 1, prefix | (d << _shift(level)), f);
+    }
+  }
+
+public:
+  //
+  // default constructor:
+  //
+  radix_set()
+      : Root(nullptr), Size(0)
+  {
+  }
+
+  //
+  // copy constructor:
+  //
+  radix_set(const radix_set &other)
+      : Root(_copy(other.Root)), Size(other.Size)
+  {
+  }
+
+  //
+  // move constructor:
+  //
+  // Takes over the nodes of other in O(1), leaving other empty.
+  //
+  radix_set(radix_set &&other)
+      : Root(other.Root), Size(other.Size)
+  {
+    other.Root = nullptr;
+    other.Size = 0;
+  }
+
+  //
+  // copy / move assignment:
+  //
+  // other is a copy, or the moved-from set; swapping with it hands
+  // the old nodes to other, which frees them on its way out.
+  //
+  radix_set &operator=(radix_set other)
+  {
+    std::swap(this->Root, other.Root);
+    std::swap(this->Size, other.Size);
+
+    return *this;
+  }
+
+  //
+  // destructor:
+  //
+  ~radix_set()
+  {
+    _destroy(this->Root);
+  }
+
+  //
+  // size
+  //
+  // Returns # of elements in the set
+  //
+  int size()
+  {
+    return this->Size;
+  }
+
+  //
+  // contains
+  //
+  // Returns true if set contains key, false if not
+  //
+  bool contains(TKey key)
+  {
+    UKEY u = _toUnsigned(key);
+    NODE *cur = this->Root;
+
+    if (cur == nullptr)
+      return false;
+
+    for (int level = 0;; level++)
+    {
+      int d = _digit(u, level);
+
+      if (((cur->Bits >> d) & 1) == 0)
+        return false;
+
+      if (level == LEVELS - 1)
+        return true;
+
+      cur = _child(cur, d);
+    }
+  }
+
+  //
+  // insert
+  //
+  // Inserts the given key into the set; if the key is already in
+  // the set then this function has no effect.
+  //
+  void insert(TKey key)
+  {
+    UKEY u = _toUnsigned(key);
+
+    if (this->Root == nullptr)
+      this->Root = new NODE();
+
+    NODE *cur = this->Root;
+
+    for (int level = 0; level < LEVELS - 1; level++)
+    {
+      int d = _digit(u, level);
+      int i = __builtin_popcountll(cur->Bits & ((1ULL << d) - 1));
+
+      if (((cur->Bits >> d) & 1) == 0)
+      {
+        cur->Children.insert(cur->Children.begin() + i, new NODE());
+        cur->Bits |= 1ULL << d;
+      }
+
+      cur = cur->Children[i];
+    }
+
+    int d = _digit(u, LEVELS - 1);
+
+    if (((cur->Bits >> d) & 1) == 0)
+    {
+      cur->Bits |= 1ULL << d;
+      this->Size++;
+    }
+  }
+
+  //
+  // []
+  //
+  // Returns true if set contains key, false if not.
+  //
+  bool operator[](TKey key)
+  {
+    return this->contains(key);
+  }
+
+  //
+  // for_each
+  //
+  // Calls f(key) for every key in the set, in order.
+  //
+  template <typename F>
+  void for_each(F f)
+  {
+    if (this->Root != nullptr)
+      _forEach(this->Root, 0, 0, f);
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order, in a vector.
+  //
+  std::vector<TKey> toVector()
+  {
+    std::vector<TKey> V;
+    V.reserve(this->Size);
+
+    this->for_each([&](TKey key) { V.push_back(key); });
+
+    return V;
+  }
+
+  // #################################################################
+  //
+  // class iterator:
+  //
+  // Holds the current key and its path from the root; ++ looks for
+  // a higher bit in the last-level word first and only climbs the
+  // path when the word has none.
+  //
+  class iterator
+  {
+  private:
+    NODE *Path[LEVELS]; // Path[0] == nullptr => end
+    UKEY U;
+
+    friend class radix_set;
+
+  public:
+    iterator()
+        : U(0)
+    {
+      this->Path[0] = nullptr;
+    }
+
+    TKey operator*()
+    {
+      if (this->Path[0] == nullptr)
+        throw std::out_of_range("radix_set::iterator:operator*");
+
+      return _toKey(this->U);
+    }
+
+    bool operator==(iterator other)
+    {
+      if (this->Path[0] == nullptr || other.Path[0] == nullptr)
+        return this->Path[0] == other.Path[0];
+
+      return this->U == other.U;
+    }
+
+    bool operator!=(iterator other)
+    {
+      return !(*this == other);
+    }
+
+    void operator++()
+    {
+      if (this->Path[0] == nullptr)
+        return;
+
+      if (!_upFrom(this->Path, LEVELS - 1, this->U, this->U))
+        this->Path[0] = nullptr;
+    }
+  };
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first element that is not
+  // less than key, or end() if there is no such element.
+  //
+  iterator lower_bound(TKey key)
+  {
+    iterator iter;
+
+    if (!_seek(_toUnsigned(key), iter.Path, iter.U))
+      iter.Path[0] = nullptr;
+
+    return iter;
+  }
+
+  //
+  // find:
+  //
+  // If the set contains key, then an iterator denoting this
+  // element is returned. If the set does not contain key,
+  // then set.end() is returned.
+  //
+  iterator find(TKey key)
+  {
+    iterator iter = this->lower_bound(key);
+
+    if (iter.Path[0] != nullptr && iter.U != _toUnsigned(key))
+      iter.Path[0] = nullptr;
+
+    return iter;
+  }
+
+  iterator begin()
+  {
+    iterator iter;
+
+    if (this->Root != nullptr)
+    {
+      iter.Path[0] = this->Root;
+      iter.U = _descendMin(iter.Path, 0, __builtin_ctzll(this->Root->Bits), 0);
+    }
+
+    return iter;
+  }
+
+  iterator end()
+  {
+    return iterator();
+  }
+};
+
+// #################################################################
+//
+// Selecting radix_set automatically:
+//
+// fast_set<TKey> is radix_set<TKey> when set_use_radix<TKey> is
+// true, which by default it is for integral keys other than bool,
+// and set<TKey> otherwise. To keep set<TKey> for some integral type, e.g. because
+// split/join are needed, opt out with
+//
+//   template <> struct set_use_radix<long long> : std::false_type {};
+//
+template <typename TKey>
+struct set_use_radix
+    : std::integral_constant<bool, std::is_integral<TKey>::value && !std::is_same<TKey, bool>::value>
+{
+};
+
+template <typename TKey>
+using fast_set = typename std::conditional<set_use_radix<TKey>::value, radix_set<TKey>, set<TKey>>::type;
@@ -24,6 +24,46 @@
 #include <vector>
 #include <utility> // std::pair
 #include <cassert>
+#include <stdexcept>
+#include <algorithm> // std::sort, std::is_sorted
+#include <memory>    // std::shared_ptr
+#include <functional> // std::less
+#include <cmath>      // std::log
+#include <climits>    // INT_MAX
+
+#include "frozen_set.h"
+#include "set_key_prefix.h"
+#include "set_hash.h"
+#include "bloom_filter.h"
+#include "set_codec.h"
+
+//
+// How set keeps its tree in shape (see set::balancing):
+//
+//   none  -- keys stay where insert put them; the depth depends on
+//            the order of insertion. This is the default.
+//   splay -- every key found by contains/find, or inserted, is
+//            rotated up to the root (splayed), so recently used keys
+//            are near the root and any sequence of operations costs
+//            amortized O(log n) each.
+//   scapegoat -- an insert that lands deeper than log base 1/alpha
+//            of n rebuilds the subtree of one of its ancestors
+//            perfectly balanced, keeping the depth O(log n) with
+//            amortized O(log n) inserts and no per-node balance
+//            data.
+//   treap -- the tree is kept heap-ordered by a priority computed
+//            from the hash of each key, so its shape depends only on
+//            the keys, not on the order they came in, and is the
+//            same on every run and machine. The expected depth is
+//            O(log n) for any input. Needs std::hash<TKey>.
+//
+enum class set_balance
+{
+  none,
+  splay,
+  scapegoat,
+  treap
+};
 
 template <typename TKey>
 class set
@@ -33,23 +73,28 @@ private:
   //
   // A node in the search tree:
   //
-  class NODE
+  // The fields a descent reads (the key prefix, if enabled, and the
+  // links) come first, and the key, which is read only on prefix
+  // ties, comes last; see set_key_prefix.h.
+  //
+  class NODE : public set_key_prefix_field<TKey>
   {
   private:
-    TKey Key;
-    bool isThreaded : 1; // 1 bit
     NODE *Left;
     NODE *Right;
+    bool isThreaded : 1; // 1 bit
+    TKey Key;
 
   public:
     // constructor:
-    NODE(TKey key)
-        : Key(key), isThreaded(false), Left(nullptr), Right(nullptr)
+    NODE(const TKey &key)
+        : Left(nullptr), Right(nullptr), isThreaded(false), Key(key)
     {
+      this->set_Prefix(key);
     }
 
     // getters:
-    TKey get_Key() { return this->Key; }
+    TKey &get_Key() { return this->Key; }
     bool get_isThreaded() { return this->isThreaded; }
     NODE *get_Left() { return this->Left; }
 
@@ -77,6 +122,17 @@ private:
     void set_Right(NODE *right) { this->Right = right; }
   };
 
+  //
+  // A block of nodes allocated together by compact(), in in-order
+  // sequence. Nodes in an arena are not deleted one by one; the
+  // arena frees them all when the last set using it lets go of it.
+  // Sets share an arena when split() hands its nodes to two sets.
+  //
+  struct ARENA
+  {
+    std::vector<NODE> Nodes;
+  };
+
   // #################################################################
   //
   // set data members:
@@ -84,6 +140,29 @@ private:
   NODE *Root; // pointer to root node
   int Size;   // # of nodes in tree
 
+  std::vector<std::shared_ptr<ARENA>> Arenas; // blocks holding some of our nodes
+
+  std::unique_ptr<bloom_filter<TKey>> Filter; // nullptr => no filter
+
+  struct CACHE_ENTRY
+  {
+    unsigned long long Hash;
+    NODE *Node; // nullptr => empty
+  };
+
+  std::vector<CACHE_ENTRY> Cache; // empty => no cache
+  unsigned long long CacheHits;
+  unsigned long long CacheMisses;
+
+  set_balance Balance;
+  std::vector<NODE *> Path; // root-to-node path, for splaying
+
+  static const int MERGE_RATIO = 8;  // size ratio below which sets are merged
+  static const int GALLOP_STEPS = 64; // most thread steps before a finger descent
+  static const int BATCH_LANES = 16; // descents in flight in contains_batch
+
+  static constexpr double SCAPEGOAT_ALPHA = 0.7; // max share of a subtree in one child
+
   // #################################################################
   //
   // set methods:
@@ -93,7 +172,7 @@ public:
   // default constructor:
   //
   set()
-      : Root(nullptr), Size(0)
+      : Root(nullptr), Size(0), CacheHits(0), CacheMisses(0), Balance(set_balance::none)
   {
   }
 
@@ -120,9 +199,52 @@ private:
 
 public:
   set(const set &other)
-      : Root(nullptr), Size(0)
+      : Root(nullptr), Size(0), CacheHits(0), CacheMisses(0), Balance(other.Balance)
   {
     _copy(other.Root);
+
+    if (other.Filter != nullptr)
+      this->Filter.reset(new bloom_filter<TKey>(*other.Filter));
+
+    if (!other.Cache.empty()) // same size, but our own nodes:
+      this->Cache.assign(other.Cache.size(), CACHE_ENTRY{0, nullptr});
+  }
+
+  //
+  // move constructor:
+  //
+  // Takes over the nodes of other in O(1), leaving other empty.
+  //
+  set(set &&other)
+      : Root(other.Root), Size(other.Size), Arenas(std::move(other.Arenas)), Filter(std::move(other.Filter)),
+        Cache(std::move(other.Cache)), CacheHits(other.CacheHits), CacheMisses(other.CacheMisses),
+        Balance(other.Balance)
+  {
+    other.Root = nullptr;
+    other.Size = 0;
+    other.Arenas.clear();
+    other.Cache.clear();
+  }
+
+  //
+  // copy / move assignment:
+  //
+  // other is a copy, or the moved-from set; swapping with it hands
+  // the old nodes to other, which frees them on its way out. The
+  // cache moves along with the nodes it points to.
+  //
+  set &operator=(set other)
+  {
+    std::swap(this->Root, other.Root);
+    std::swap(this->Size, other.Size);
+    std::swap(this->Arenas, other.Arenas);
+    std::swap(this->Filter, other.Filter);
+    std::swap(this->Cache, other.Cache);
+    std::swap(this->CacheHits, other.CacheHits);
+    std::swap(this->CacheMisses, other.CacheMisses);
+    std::swap(this->Balance, other.Balance);
+
+    return *this;
   }
 
   //
@@ -137,8 +259,33 @@ private:
     {
       _destroy(cur->get_Left());
       _destroy(cur->get_Right());
-      delete cur;
+      _free(cur);
+    }
+  }
+
+  //
+  // deletes a node, unless it lives in one of our arenas:
+  //
+  bool _inArena(NODE *cur)
+  {
+    std::less<NODE *> less;
+
+    for (auto &arena : this->Arenas)
+    {
+      NODE *first = arena->Nodes.data();
+      NODE *last = first + arena->Nodes.size();
+
+      if (!less(cur, first) && less(cur, last))
+        return true;
     }
+
+    return false;
+  }
+
+  void _free(NODE *cur)
+  {
+    if (!_inArena(cur))
+      delete cur;
   }
 
 public:
@@ -151,6 +298,70 @@ public:
     _destroy(this->Root); // call to destructor
   }
 
+  //
+  // compact
+  //
+  // Moves every node into one contiguous block, in sorted order,
+  // keeping the shape of the tree. After many random inserts the
+  // nodes are scattered across the heap; afterwards an in-order
+  // walk (iterator, for_each, toVector) reads memory sequentially,
+  // since each node's successor is its neighbour in the block.
+  // The copy is built before anything is released, so if an
+  // allocation fails the set is left as it was. Iterators into the
+  // set are invalidated.
+  //
+private:
+  NODE *_compactCopy(NODE *old, ARENA &arena)
+  {
+    if (old == nullptr)
+      return nullptr;
+
+    NODE *left = _compactCopy(old->get_Left(), arena);
+
+    arena.Nodes.emplace_back(old->get_Key()); // in-order => sorted
+    NODE *n = &arena.Nodes.back();
+
+    NODE *right = _compactCopy(old->get_Right(), arena);
+
+    n->set_Left(left);
+    n->set_Right(right);
+    n->set_isThreaded(right == nullptr);
+
+    return n;
+  }
+
+public:
+  void compact()
+  {
+    std::shared_ptr<ARENA> arena = std::make_shared<ARENA>();
+    arena->Nodes.reserve(this->Size); // no reallocation => stable pointers
+
+    NODE *root = _compactCopy(this->Root, *arena);
+
+    //
+    // a node with no right child is threaded to the next node in
+    // sorted order, which is now simply the next one in the block:
+    //
+    std::vector<NODE> &nodes = arena->Nodes;
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+      if (nodes[i].get_isThreaded())
+        nodes[i].set_Right((i + 1 < nodes.size()) ? &nodes[i + 1] : nullptr);
+    }
+
+    //
+    // release the old nodes, and switch over:
+    //
+    _destroy(this->Root);
+
+    this->Root = root;
+    this->Arenas.clear();
+    this->Arenas.push_back(arena);
+
+    _clearCache();
+  }
+
   //
   // size
   //
@@ -161,33 +372,327 @@ public:
     return this->Size;
   }
 
+  //
+  // height
+  //
+  // Returns the # of levels in the tree, 0 if empty.
+  //
+private:
+  static int _height(NODE *cur)
+  {
+    if (cur == nullptr)
+      return 0;
+    else
+      return 1 + std::max(_height(cur->get_Left()), _height(cur->get_Right()));
+  }
+
+public:
+  int height()
+  {
+    return _height(this->Root);
+  }
+
+  //
+  // A key being searched for, along with its prefix, so the prefix
+  // is computed once per search rather than once per node. (Key is
+  // non-const since TKey's operator< need not be; it is only ever
+  // compared, never changed.)
+  //
+private:
+  struct PROBE
+  {
+    TKey &Key;
+    unsigned long long Prefix;
+
+    PROBE(const TKey &key)
+        : Key(const_cast<TKey &>(key)), Prefix(set_key_prefix<TKey>::of(key))
+    {
+    }
+  };
+
+  //
+  // _compare
+  //
+  // Returns < 0 if the probe's key is less than cur's key, > 0 if it
+  // is greater, and 0 if they are equal. The prefixes are compared
+  // first; cur's key is only read if they tie.
+  //
+  static int _compare(const PROBE &probe, NODE *cur)
+  {
+    if (set_key_prefix<TKey>::enabled)
+    {
+      unsigned long long prefix = cur->get_Prefix();
+
+      if (probe.Prefix != prefix)
+        return (probe.Prefix < prefix) ? -1 : 1;
+    }
+
+    if (probe.Key < cur->get_Key())
+      return -1;
+    else if (cur->get_Key() < probe.Key)
+      return 1;
+    else
+      return 0;
+  }
+
   //
   // contains
   //
   // Returns true if set contains key, false if not
   //
 
+public:
+  bool contains(TKey key)
+  {
+    return _lookup(key) != nullptr;
+  }
+
 private:
-  bool _contains(NODE *cur, TKey key)
+  //
+  // _lookup
+  //
+  // Returns the node holding key, or nullptr. Checks the cache and
+  // the filter, if enabled, before descending from the root.
+  //
+  NODE *_lookup(const TKey &key)
   {
-    if (cur == nullptr)
-      return false;
-    else
+    PROBE probe(key);
+    CACHE_ENTRY *entry = nullptr;
+
+    if constexpr (set_hashable<TKey>::value)
+    {
+      if (!this->Cache.empty())
+      {
+        unsigned long long hash = set_hash(key);
+        entry = &this->Cache[hash & (this->Cache.size() - 1)];
+
+        if (entry->Node != nullptr && entry->Hash == hash && _compare(probe, entry->Node) == 0)
+        {
+          this->CacheHits++;
+          return entry->Node;
+        }
+
+        this->CacheMisses++;
+        entry->Hash = hash;
+      }
+    }
+
+    if (!_filterMayContain(key))
+      return nullptr;
+
+    NODE *cur = this->Root;
+    bool splay = (this->Balance == set_balance::splay);
+
+    while (cur != nullptr)
     {
+      if (splay)
+        this->Path.push_back(cur);
 
-      if (key < cur->get_Key()) // search left:
-        return _contains(cur->get_Left(), key);
-      else if (cur->get_Key() < key) // search right:
-        return _contains(cur->get_Right(), key);
+      int c = _compare(probe, cur);
+
+      if (c < 0) // search left:
+        cur = cur->get_Left();
+      else if (c > 0) // search right:
+        cur = cur->get_Right();
       else // must be equal, found it!
-        return true;
+        break;
     }
+
+    if (splay) // the key, or the last node before we fell out:
+      _splay();
+
+    if (cur != nullptr && entry != nullptr) // remember it, replacing what was there:
+      entry->Node = cur;
+
+    return cur;
   }
 
 public:
-  bool contains(TKey key)
+  //
+  // enable_cache / disable_cache / cache_hits / cache_misses
+  //
+  // Keeps a direct-mapped cache of the nodes most recently found by
+  // contains(), find() and [], indexed by the key's hash, which is
+  // checked before descending. For skewed lookups, where a few keys
+  // get most of them, those keys are then found without a descent.
+  // The size is rounded up to a power of 2; the hit and miss counts
+  // show whether it is big enough. Inserts leave the cache valid;
+  // operations that free or move nodes (erase_range, split, join,
+  // compact) clear it. TKey must be hashable with std::hash.
+  //
+  void enable_cache(int entries = 4096)
+  {
+    static_assert(set_hashable<TKey>::value, "set::enable_cache: std::hash<TKey> is required");
+
+    size_t n = 1;
+    while (n < (size_t)entries)
+      n *= 2;
+
+    this->Cache.assign(n, CACHE_ENTRY{0, nullptr});
+    this->CacheHits = 0;
+    this->CacheMisses = 0;
+  }
+
+  void disable_cache()
+  {
+    this->Cache.clear();
+  }
+
+  unsigned long long cache_hits() { return this->CacheHits; }
+  unsigned long long cache_misses() { return this->CacheMisses; }
+
+private:
+  void _clearCache()
+  {
+    for (CACHE_ENTRY &entry : this->Cache)
+      entry.Node = nullptr;
+  }
+
+public:
+
+  //
+  // enable_filter / disable_filter / rebuild_filter
+  //
+  // Keeps a blocked Bloom filter of the keys (see bloom_filter.h)
+  // at about bitsPerKey bits per key, which contains() and find()
+  // check before descending: a key the filter has never seen is
+  // reported missing after one cache miss. At 10 bits per key about
+  // 1% of absent keys get past the filter. Inserts add to it, and
+  // it is rebuilt at twice the size when the set outgrows it.
+  // Erased keys stay in the filter, so after large erase_range()s
+  // call rebuild_filter() to drop them. TKey must be hashable with
+  // std::hash.
+  //
+  void enable_filter(int bitsPerKey = 10)
+  {
+    static_assert(set_hashable<TKey>::value, "set::enable_filter: std::hash<TKey> is required");
+
+    _buildFilter(bitsPerKey);
+  }
+
+  void disable_filter()
+  {
+    this->Filter.reset();
+  }
+
+  void rebuild_filter()
+  {
+    if (this->Filter != nullptr)
+      _buildFilter(this->Filter->bitsPerKey());
+  }
+
+private:
+  // false => key is surely not in the set:
+  bool _filterMayContain(const TKey &key)
+  {
+    if constexpr (set_hashable<TKey>::value)
+      return this->Filter == nullptr || this->Filter->mayContain(key);
+    else
+      return true;
+  }
+
+  // call only once the tree is consistent, as it may rebuild:
+  void _filterAdd(const TKey &key)
+  {
+    if constexpr (set_hashable<TKey>::value)
+    {
+      if (this->Filter == nullptr)
+        return;
+
+      this->Filter->add(key);
+
+      if (this->Filter->full())
+        _buildFilter(this->Filter->bitsPerKey());
+    }
+  }
+
+  void _buildFilter(int bitsPerKey)
+  {
+    if constexpr (set_hashable<TKey>::value)
+    {
+      size_t capacity = std::max((size_t)1024, 2 * (size_t)this->Size);
+      std::unique_ptr<bloom_filter<TKey>> filter(new bloom_filter<TKey>(capacity, bitsPerKey));
+
+      for (NODE *cur = (this->Root == nullptr) ? nullptr : _leftmost(this->Root); cur != nullptr; cur = _successor(cur))
+        filter->add(cur->get_Key());
+
+      this->Filter = std::move(filter);
+    }
+  }
+
+public:
+
+  //
+  // contains_batch
+  //
+  // Sets bit i of out_bits (bit i % 64 of word i / 64) if the set
+  // contains keys[i], and clears it otherwise; out_bits is resized
+  // to fit. Instead of one descent after another, BATCH_LANES
+  // descents advance in lockstep, one level per round, and each
+  // prefetches the node it will visit in the next round. The cache
+  // misses of different keys then overlap rather than being paid
+  // one at a time. A lane whose descent ends picks up the next key.
+  //
+  void contains_batch(const std::vector<TKey> &keys, std::vector<unsigned long long> &out_bits)
   {
-    return _contains(this->Root, key);
+    size_t n = keys.size();
+    out_bits.assign((n + 63) / 64, 0);
+
+    NODE *cur[BATCH_LANES];   // where each lane is
+    size_t index[BATCH_LANES]; // which key each lane is looking for
+    int active = 0;
+    size_t next = 0;
+
+    while (active < BATCH_LANES && next < n)
+    {
+      cur[active] = this->Root;
+      index[active] = next++;
+      active++;
+    }
+
+    while (active > 0)
+    {
+      int lane = 0;
+
+      while (lane < active)
+      {
+        NODE *c = cur[lane];
+        PROBE probe(keys[index[lane]]);
+        int cmp = 0;
+        bool done = false;
+
+        if (c == nullptr)
+          done = true; // fell out of the tree: not found
+        else if ((cmp = _compare(probe, c)) < 0)
+          c = c->get_Left();
+        else if (cmp > 0)
+          c = c->get_Right();
+        else
+        { // found:
+          out_bits[index[lane] / 64] |= 1ULL << (index[lane] % 64);
+          done = true;
+        }
+
+        if (!done)
+        {
+          __builtin_prefetch(c);
+          cur[lane] = c;
+          lane++;
+        }
+        else if (next < n)
+        { // start the next key in this lane:
+          cur[lane] = this->Root;
+          index[lane] = next++;
+          lane++;
+        }
+        else
+        { // no keys left, retire the lane:
+          active--;
+          cur[lane] = cur[active];
+          index[lane] = index[active];
+        }
+      }
+    }
   }
 
   //
@@ -196,29 +701,45 @@ public:
   // Inserts the given key into the set; if the key is already in
   // the set then this function has no effect.
   //
-  void insert(TKey key)
+private:
+  // returns the node holding key, new or existing:
+  NODE *_insert(TKey key)
   {
     NODE *prev = nullptr;
     NODE *cur = this->Root;
+    PROBE probe(key);
+    int c = 0;
+    bool splay = (this->Balance == set_balance::splay);
+    bool scapegoat = (this->Balance == set_balance::scapegoat);
+    bool treap = (this->Balance == set_balance::treap);
 
     //
     // 1. Search for key, return if found:
     //
     while (cur != nullptr)
     {
-      if (key < cur->get_Key())
+      if (splay || scapegoat || treap)
+        this->Path.push_back(cur);
+
+      c = _compare(probe, cur);
+
+      if (c < 0)
       { // left:
         prev = cur;
         cur = cur->get_Left();
       }
-      else if (cur->get_Key() < key)
+      else if (c > 0)
       { // right:
         prev = cur;
         cur = cur->get_Right();
       }
       else
-      {         // must be equal => already in tree
-        return; // don't insert again
+      {             // must be equal => already in tree
+        if (splay)
+          _splay();
+
+        this->Path.clear();
+        return cur; // don't insert again
       }
     }
 
@@ -237,7 +758,7 @@ public:
       n->set_isThreaded(true); // set as threaded node
       n->set_Right(nullptr);   // threaded to nullptr
     }
-    else if (key < prev->get_Key())
+    else if (c < 0)
     {
       //
       // we are to the left of our parent:
@@ -263,33 +784,851 @@ public:
     // STEP 3: update size and return
     //
     this->Size++;
-    return;
+
+    if (splay)
+    {
+      this->Path.push_back(n);
+      _splay();
+    }
+    else if (scapegoat)
+      _rebalanceAfterInsert(n);
+    else if (treap)
+      _treapSiftUp(n);
+
+    return n;
   }
 
-  //
-  // []
-  //
-  // Returns true if set contains key, false if not.
-  //
-  bool operator[](TKey key)
+public:
+  void insert(TKey key)
   {
-    return this->contains(key);
+    int size = this->Size;
+
+    this->_insert(key);
+
+    if (this->Size != size)
+      _filterAdd(key);
   }
 
   //
-  // toVector
+  // balancing
   //
-  // Returns the elements of the set, in order,
-  // in a vector.
+  // Selects how the tree is kept in shape from now on; see
+  // set_balance. Switching to scapegoat rebuilds the whole tree
+  // balanced, since later inserts only look for imbalance along
+  // their own path; otherwise the current shape is kept.
   //
-private:
-  void _toVector(NODE *cur, std::vector<TKey> &V)
+  // A treap needs std::hash<TKey>, which is checked at compile
+  // time: balancing(mode) takes any mode, so it needs a hashable
+  // TKey; for other keys, name the mode as balancing<mode>(), e.g.
+  // S.balancing<set_balance::splay>().
+  //
+  template <set_balance Mode>
+  void balancing()
   {
-    if (cur == nullptr)
-      return;
-    else
-    {
-      //
+    static_assert(Mode != set_balance::treap || set_hashable<TKey>::value,
+                  "set::balancing: treap needs std::hash<TKey>");
+
+    _balancing(Mode);
+  }
+
+  void balancing(set_balance mode)
+  {
+    static_assert(set_hashable<TKey>::value,
+                  "set::balancing: std::hash<TKey> is required, use balancing<mode>() instead");
+
+    _balancing(mode);
+  }
+
+  set_balance balancing()
+  {
+    return this->Balance;
+  }
+
+private:
+  void _balancing(set_balance mode)
+  {
+    this->Balance = mode;
+
+    if (mode == set_balance::scapegoat && this->Root != nullptr)
+      this->Root = _rebuild(this->Root);
+    else if (mode == set_balance::treap && this->Root != nullptr)
+      this->Root = _rebuild(this->Root, true);
+  }
+
+  //
+  // _rotateUp
+  //
+  // Rotates child, a child of parent, above parent and returns it;
+  // the caller links child in where parent was. Threads point at
+  // in-order successors, which a rotation does not change, so the
+  // only care needed is for the one link that switches between
+  // child and thread:
+  //
+  //   right rotation: if child had no right subtree, its thread
+  //   pointed at parent, and now a real link does; parent's left
+  //   becomes empty.
+  //
+  //   left rotation: if child had no left subtree, parent is left
+  //   with no right subtree, so it is threaded to child, its
+  //   successor.
+  //
+  static NODE *_rotateUp(NODE *child, NODE *parent)
+  {
+    if (parent->get_Left() == child)
+    {
+      if (child->get_isThreaded())
+      {
+        parent->set_Left(nullptr);
+        child->set_isThreaded(false);
+      }
+      else
+        parent->set_Left(child->get_Right());
+
+      child->set_Right(parent);
+    }
+    else
+    {
+      NODE *middle = child->get_Left();
+
+      if (middle == nullptr)
+        parent->set_isThreaded(true);
+
+      parent->set_Right((middle == nullptr) ? child : middle);
+      child->set_Left(parent);
+    }
+
+    return child;
+  }
+
+  // makes n the child of parent that old was, or the root:
+  void _replaceChild(NODE *parent, NODE *old, NODE *n)
+  {
+    if (parent == nullptr)
+      this->Root = n;
+    else if (parent->get_Left() == old)
+      parent->set_Left(n);
+    else
+      parent->set_Right(n);
+  }
+
+  //
+  // _splay
+  //
+  // Moves the last node of Path, which holds the path to it from
+  // the root, up to the root by zig-zig and zig-zag steps, which
+  // also roughly halve the depth of every node along the path.
+  // Empties Path.
+  //
+  void _splay()
+  {
+    if (this->Path.empty())
+      return;
+
+    size_t k = this->Path.size() - 1;
+    NODE *x = this->Path[k];
+
+    while (k >= 2)
+    {
+      NODE *p = this->Path[k - 1];
+      NODE *g = this->Path[k - 2];
+
+      if ((g->get_Left() == p) == (p->get_Left() == x))
+      { // zig-zig: same side twice, rotate p first:
+        _rotateUp(p, g);
+        _rotateUp(x, p);
+      }
+      else
+      { // zig-zag:
+        _rotateUp(x, p);
+        _replaceChild(g, p, x);
+        _rotateUp(x, g);
+      }
+
+      _replaceChild((k >= 3) ? this->Path[k - 3] : nullptr, g, x);
+      k -= 2;
+    }
+
+    if (k == 1)
+    { // zig: x is a child of the root:
+      _rotateUp(x, this->Path[0]);
+      this->Root = x;
+    }
+
+    this->Path.clear();
+  }
+
+  //
+  // _count
+  //
+  // Returns the # of nodes in the subtree, by following threads
+  // from its smallest node to its largest.
+  //
+  static int _count(NODE *sub)
+  {
+    if (sub == nullptr)
+      return 0;
+
+    NODE *last = _rightmost(sub);
+    int n = 1;
+
+    for (NODE *cur = _leftmost(sub); cur != last; cur = _successor(cur))
+      n++;
+
+    return n;
+  }
+
+  //
+  // _rebuild
+  //
+  // Relinks the subtree perfectly balanced, or as a treap, and
+  // returns its new root. Its nodes are listed in order along the
+  // threads, and the largest keeps its thread out of the subtree.
+  //
+  static NODE *_rebuild(NODE *sub, bool treap = false)
+  {
+    NODE *last = _rightmost(sub);
+    NODE *after = last->get_Thread();
+    std::vector<NODE *> nodes;
+
+    for (NODE *cur = _leftmost(sub);; cur = _successor(cur))
+    {
+      nodes.push_back(cur);
+
+      if (cur == last)
+        break;
+    }
+
+    return treap ? _linkTreap(nodes, after) : _linkBalanced(nodes, after);
+  }
+
+  //
+  // treaps:
+  //
+  // A node's priority is a hash of its key; a parent's priority is
+  // never less than its children's.
+  //
+  static unsigned long long _priority(NODE *n)
+  {
+    if constexpr (set_hashable<TKey>::value)
+      return set_hash(n->get_Key());
+    else
+      return 0;
+  }
+
+  //
+  // _linkTreap
+  //
+  // As _linkBalanced, but links the sorted nodes into a treap, in
+  // O(n): the rightmost path of the treap built so far is kept on
+  // a stack, and each new (largest) node goes at the bottom of it,
+  // taking over as its left subtree the nodes of lower priority
+  // that it pops.
+  //
+  static NODE *_linkTreap(std::vector<NODE *> &nodes, NODE *after)
+  {
+    std::vector<std::pair<NODE *, unsigned long long>> spine;
+
+    for (NODE *n : nodes)
+    {
+      unsigned long long p = _priority(n);
+      NODE *popped = nullptr;
+
+      while (!spine.empty() && spine.back().second < p)
+      {
+        popped = spine.back().first;
+        spine.pop_back();
+      }
+
+      n->set_Left(popped);
+      n->set_Right(nullptr);
+      n->set_isThreaded(true); // for now
+
+      if (!spine.empty())
+      {
+        spine.back().first->set_isThreaded(false);
+        spine.back().first->set_Right(n);
+      }
+
+      spine.push_back(std::make_pair(n, p));
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+      if (nodes[i]->get_isThreaded())
+        nodes[i]->set_Right((i + 1 < nodes.size()) ? nodes[i + 1] : after);
+    }
+
+    return spine.empty() ? nullptr : spine.front().first;
+  }
+
+  //
+  // _treapSiftUp
+  //
+  // n was just inserted as a leaf at the end of Path; rotates it up
+  // while its priority is above its parent's. Empties Path.
+  //
+  void _treapSiftUp(NODE *n)
+  {
+    unsigned long long p = _priority(n);
+    size_t k = this->Path.size();
+
+    while (k > 0 && _priority(this->Path[k - 1]) < p)
+    {
+      NODE *parent = this->Path[k - 1];
+
+      _rotateUp(n, parent);
+      _replaceChild((k >= 2) ? this->Path[k - 2] : nullptr, parent, n);
+      k--;
+    }
+
+    this->Path.clear();
+  }
+
+  //
+  // _treapJoin
+  //
+  // Joins two treaps, where every key of a is less than every key
+  // of b, by merging their boundary paths: a's right spine and b's
+  // left spine, in priority order. The largest node of a must
+  // already be threaded to the smallest of b.
+  //
+  static NODE *_treapJoin(NODE *a, NODE *b)
+  {
+    if (a == nullptr)
+      return b;
+    else if (b == nullptr)
+      return a;
+
+    if (_priority(b) < _priority(a))
+    {
+      NODE *right = _treapJoin(a->get_Right(), b);
+
+      a->set_isThreaded(false);
+      a->set_Right(right);
+
+      return a;
+    }
+    else
+    {
+      b->set_Left(_treapJoin(a, b->get_Left()));
+
+      return b;
+    }
+  }
+
+  //
+  // _checkScapegoat
+  //
+  // join and erase_range link whole subtrees together without
+  // looking at their depths, so in scapegoat mode they end with a
+  // check of the height, O(n), and rebuild the whole tree if it is
+  // over the limit that inserts keep to.
+  //
+  void _checkScapegoat()
+  {
+    if (this->Balance != set_balance::scapegoat || this->Root == nullptr)
+      return;
+
+    double limit = std::log((double)this->Size) / std::log(1.0 / SCAPEGOAT_ALPHA);
+
+    if (_height(this->Root) - 1 > limit) // the deepest node's depth
+      this->Root = _rebuild(this->Root);
+  }
+
+  //
+  // _rebalanceAfterInsert
+  //
+  // n was just inserted at the end of Path. If it is deeper than
+  // log base 1/alpha of the size, some ancestor has a child holding
+  // more than alpha of its subtree (the scapegoat); walking up, the
+  // subtree sizes are found by counting only the sibling subtrees,
+  // and the first such ancestor's subtree is rebuilt. The rebuild
+  // costs O(size of that subtree), which amortizes to O(log n) per
+  // insert. Empties Path.
+  //
+  void _rebalanceAfterInsert(NODE *n)
+  {
+    int depth = (int)this->Path.size();
+    double limit = std::log((double)this->Size) / std::log(1.0 / SCAPEGOAT_ALPHA);
+
+    if (depth > limit)
+    {
+      NODE *child = n;
+      int size = 1; // of child's subtree
+
+      for (int i = depth - 1; i >= 0; i--)
+      {
+        NODE *parent = this->Path[i];
+        NODE *sibling = (parent->get_Left() == child) ? parent->get_Right() : parent->get_Left();
+        int parentSize = size + 1 + _count(sibling);
+
+        if (size > SCAPEGOAT_ALPHA * parentSize)
+        {
+          _replaceChild((i > 0) ? this->Path[i - 1] : nullptr, parent, _rebuild(parent));
+          break;
+        }
+
+        child = parent;
+        size = parentSize;
+      }
+    }
+
+    this->Path.clear();
+  }
+
+  //
+  // _successor
+  //
+  // Returns the next in-order node after cur, or nullptr if cur
+  // is the last node; follows the thread when there is one.
+  //
+private:
+  static NODE *_successor(NODE *cur)
+  {
+    if (cur->get_isThreaded())
+      return cur->get_Thread();
+
+    return _leftmost(cur->get_Right());
+  }
+
+  //
+  // _linkBalanced
+  //
+  // Links the given nodes, which must be in sorted order, into a
+  // perfectly balanced subtree and returns its root. Nodes that
+  // end up with no right child are threaded to their in-order
+  // successor; the last node is threaded to after.
+  //
+  static NODE *_linkBalanced(std::vector<NODE *> &nodes, NODE *after)
+  {
+    NODE *root = _linkRange(nodes, 0, (int)nodes.size() - 1);
+
+    for (int i = 0; i < (int)nodes.size(); i++)
+    {
+      if (nodes[i]->get_isThreaded())
+        nodes[i]->set_Right((i + 1 < (int)nodes.size()) ? nodes[i + 1] : after);
+    }
+
+    return root;
+  }
+
+  static NODE *_linkRange(std::vector<NODE *> &nodes, int lo, int hi)
+  {
+    if (lo > hi)
+      return nullptr;
+
+    int mid = lo + (hi - lo) / 2;
+    NODE *n = nodes[mid];
+
+    NODE *left = _linkRange(nodes, lo, mid - 1);
+    NODE *right = _linkRange(nodes, mid + 1, hi);
+
+    n->set_Left(left);
+    n->set_Right(right);
+    n->set_isThreaded(right == nullptr); // fixed up by _linkBalanced
+
+    return n;
+  }
+
+  //
+  // _buildSorted
+  //
+  // Replaces the (empty) tree with a balanced tree holding the
+  // given keys, which must be sorted and free of duplicates.
+  // Runs in O(n), versus O(n log n) -- or O(n^2) for sorted
+  // input -- when calling insert n times.
+  //
+  void _buildSorted(const std::vector<TKey> &keys)
+  {
+    std::vector<NODE *> nodes;
+    nodes.reserve(keys.size());
+
+    for (const TKey &key : keys)
+      nodes.push_back(new NODE(key));
+
+    this->Root = _linkBalanced(nodes, nullptr);
+    this->Size = (int)nodes.size();
+  }
+
+  //
+  // _leftmost
+  //
+  // Returns the node with the smallest key in the subtree.
+  //
+  static NODE *_leftmost(NODE *cur)
+  {
+    while (cur->get_Left() != nullptr)
+      cur = cur->get_Left();
+
+    return cur;
+  }
+
+  //
+  // _lowerBound
+  //
+  // Returns the first node in the subtree whose key is not less
+  // than key, or nullptr if every key is less than key.
+  //
+  static NODE *_lowerBound(NODE *cur, const TKey &key)
+  {
+    NODE *result = nullptr;
+    PROBE probe(key);
+
+    while (cur != nullptr)
+    {
+      if (_compare(probe, cur) > 0) // answer is to the right:
+        cur = cur->get_Right();
+      else
+      { // cur is a candidate, look for a smaller one:
+        result = cur;
+        cur = cur->get_Left();
+      }
+    }
+
+    return result;
+  }
+
+  //
+  // _fingerLowerBound
+  //
+  // _lowerBound for keys that only grow from one call to the next.
+  // finger holds the nodes where the previous descents turned left,
+  // deepest last; every key between the last answer and such a node
+  // is in its left subtree. So the nodes less than key are popped,
+  // and the descent starts in the left subtree of the first node
+  // still on the finger (or at root if none is), costing the height
+  // of that subtree rather than of the whole tree.
+  //
+  static NODE *_fingerLowerBound(NODE *root, std::vector<NODE *> &finger, const TKey &key)
+  {
+    while (!finger.empty() && finger.back()->get_Key() < key)
+      finger.pop_back();
+
+    NODE *result = nullptr;
+    NODE *cur = root;
+    PROBE probe(key);
+
+    if (!finger.empty())
+    {
+      result = finger.back();
+      cur = result->get_Left();
+    }
+
+    while (cur != nullptr)
+    {
+      if (_compare(probe, cur) > 0) // answer is to the right:
+        cur = cur->get_Right();
+      else
+      { // cur is a candidate, look for a smaller one:
+        result = cur;
+        finger.push_back(cur);
+        cur = cur->get_Left();
+      }
+    }
+
+    return result;
+  }
+
+public:
+  //
+  // insert_batch
+  //
+  // Inserts the keys in [first, last) into the set; keys already in
+  // the set (or repeated in the batch) are ignored. The batch is
+  // sorted if it is not already, then:
+  //
+  //  - if the batch is at least as large as the set, the existing
+  //    nodes and the new ones are merged along the thread list and
+  //    relinked into a balanced tree, in O(n + m);
+  //
+  //  - otherwise each descent resumes from a "finger" on the path
+  //    of the previous one instead of from the root, so nearby keys
+  //    share the work of the descent. All batch keys falling into
+  //    the same gap between two existing keys are linked into one
+  //    balanced subtree and hung in that gap, so sorted runs do not
+  //    degenerate into a list.
+  //
+  // In treap mode the merge relinks the nodes as a treap, and a
+  // smaller batch is inserted one key at a time, since a subtree
+  // hung in a gap would break the heap order. The same goes for
+  // scapegoat mode, where a subtree hung in a gap is not checked
+  // for depth but a single insert is.
+  //
+  template <typename Iter>
+  void insert_batch(Iter first, Iter last)
+  {
+    std::vector<TKey> batch(first, last);
+
+    if (!std::is_sorted(batch.begin(), batch.end()))
+      std::sort(batch.begin(), batch.end());
+
+    _dedupSorted(batch);
+
+    if (batch.empty())
+      return;
+
+    if ((long long)batch.size() >= (long long)this->Size)
+      _mergeRebuild(batch);
+    else if (this->Balance == set_balance::treap || this->Balance == set_balance::scapegoat)
+    { // gaps can't be filled by balanced subtrees:
+      for (const TKey &key : batch)
+        _insert(key);
+    }
+    else
+      _fingerInsert(batch);
+
+    if (this->Filter != nullptr)
+    {
+      for (const TKey &key : batch)
+        _filterAdd(key);
+    }
+  }
+
+private:
+  //
+  // removes adjacent duplicates, using only operator<:
+  //
+  static void _dedupSorted(std::vector<TKey> &keys)
+  {
+    size_t out = 0;
+
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+      if (out == 0 || keys[out - 1] < keys[i])
+      {
+        if (out != i)
+          keys[out] = keys[i];
+        out++;
+      }
+    }
+
+    keys.erase(keys.begin() + out, keys.end());
+  }
+
+  //
+  // _attachBetween
+  //
+  // Hangs sub, a subtree whose keys all fall between the adjacent
+  // nodes pred and succ (either may be nullptr), into the tree. If
+  // pred has no right child the gap is there, otherwise succ must
+  // be the leftmost node of pred's right subtree and has no left
+  // child. The largest node of sub must already be threaded to succ.
+  //
+  void _attachBetween(NODE *pred, NODE *succ, NODE *sub)
+  {
+    if (pred != nullptr && pred->get_isThreaded())
+    {
+      pred->set_isThreaded(false);
+      pred->set_Right(sub);
+    }
+    else if (succ != nullptr)
+      succ->set_Left(sub);
+    else
+      this->Root = sub;
+  }
+
+  //
+  // builds one new tree from the existing nodes and the (sorted,
+  // deduplicated) batch, reusing the existing nodes:
+  //
+  void _mergeRebuild(const std::vector<TKey> &batch)
+  {
+    std::vector<NODE *> nodes;
+    nodes.reserve(this->Size + batch.size());
+
+    NODE *cur = (this->Root == nullptr) ? nullptr : _leftmost(this->Root);
+    size_t i = 0;
+
+    while (cur != nullptr || i < batch.size())
+    {
+      if (i == batch.size() || (cur != nullptr && cur->get_Key() < batch[i]))
+      {
+        nodes.push_back(cur);
+        cur = _successor(cur);
+      }
+      else if (cur == nullptr || batch[i] < cur->get_Key())
+      {
+        nodes.push_back(new NODE(batch[i]));
+        i++;
+      }
+      else
+        i++; // already in the set
+    }
+
+    if (this->Balance == set_balance::treap)
+      this->Root = _linkTreap(nodes, nullptr);
+    else
+      this->Root = _linkBalanced(nodes, nullptr);
+
+    this->Size = (int)nodes.size();
+  }
+
+  //
+  // inserts a (sorted, deduplicated) batch that is smaller than the
+  // set. The finger is the stack of nodes where the last descent
+  // turned left, each with the last node less than key seen above
+  // it. Since keys only grow, nodes at or below the next key are
+  // popped, and the descent resumes in the left subtree of the
+  // first node still above it:
+  //
+  void _fingerInsert(const std::vector<TKey> &batch)
+  {
+    std::vector<std::pair<NODE *, NODE *>> finger; // <left turn, pred>
+    std::vector<NODE *> nodes;
+    size_t i = 0;
+
+    while (i < batch.size())
+    {
+      const TKey &key = batch[i];
+
+      //
+      // 1. back up the finger until it covers key:
+      //
+      while (!finger.empty() && finger.back().first->get_Key() < key)
+        finger.pop_back();
+
+      NODE *pred = nullptr;
+      NODE *succ = nullptr;
+      NODE *cur = this->Root;
+
+      if (!finger.empty())
+      {
+        succ = finger.back().first;
+        pred = finger.back().second;
+        cur = (key < succ->get_Key()) ? succ->get_Left() : succ;
+      }
+
+      //
+      // 2. descend from there to the gap for key:
+      //
+      bool found = false;
+
+      while (cur != nullptr && !found)
+      {
+        if (cur->get_Key() < key)
+        {
+          pred = cur;
+          cur = cur->get_Right();
+        }
+        else if (key < cur->get_Key())
+        {
+          finger.push_back(std::make_pair(cur, pred));
+          succ = cur;
+          cur = cur->get_Left();
+        }
+        else
+          found = true; // already in the set
+      }
+
+      if (found)
+      {
+        i++;
+        continue;
+      }
+
+      //
+      // 3. every batch key up to succ goes into this gap:
+      //
+      nodes.clear();
+
+      while (i < batch.size() && (succ == nullptr || batch[i] < succ->get_Key()))
+      {
+        nodes.push_back(new NODE(batch[i]));
+        i++;
+      }
+
+      _attachBetween(pred, succ, _linkBalanced(nodes, succ));
+
+      this->Size += (int)nodes.size();
+    }
+  }
+
+public:
+  //
+  // []
+  //
+  // Returns true if set contains key, false if not.
+  //
+  bool operator[](TKey key)
+  {
+    return this->contains(key);
+  }
+
+  //
+  // for_each
+  //
+  // Calls f(key) for every key in the set, in order, by walking the
+  // threads. A thread walk is a chain of dependent loads, so with
+  // prefetch the walk runs one node ahead: while f handles a key,
+  // the node two places after it is already being fetched, and its
+  // miss overlaps with the work instead of following it. When the
+  // walk goes down a left spine, the right subtrees hanging off it
+  // are fetched as well, since they are visited next.
+  //
+  template <typename F>
+  void for_each(F f, bool prefetch = true)
+  {
+    if (this->Root == nullptr)
+      return;
+
+    NODE *cur = _leftmost(this->Root);
+
+    if (!prefetch)
+    {
+      for (; cur != nullptr; cur = _successor(cur))
+        f(cur->get_Key());
+      return;
+    }
+
+    NODE *next = _successor(cur);
+
+    while (cur != nullptr)
+    {
+      NODE *after = nullptr;
+
+      if (next != nullptr) // next was requested a step ago
+      {
+        if (next->get_isThreaded())
+          after = next->get_Thread();
+        else
+        {
+          //
+          // the nodes on the way down to the successor are visited
+          // later, and so are their right subtrees, so start
+          // fetching those too:
+          //
+          after = next->get_Right();
+          while (after->get_Left() != nullptr)
+          {
+            __builtin_prefetch(after->get_Right());
+            after = after->get_Left();
+          }
+        }
+
+        __builtin_prefetch(after);
+      }
+
+      f(cur->get_Key());
+
+      cur = next;
+      next = after;
+    }
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order,
+  // in a vector.
+  //
+private:
+  void _toVector(NODE *cur, std::vector<TKey> &V)
+  {
+    if (cur == nullptr)
+      return;
+    else
+    {
+      //
       // we want them in order, so go left, then
       // middle, then right:
       //
@@ -299,16 +1638,142 @@ private:
     }
   }
 
-public:
-  std::vector<TKey> toVector()
+public:
+  std::vector<TKey> toVector()
+  {
+    std::vector<TKey> V;
+
+    _toVector(this->Root, V);
+
+    return V;
+  }
+
+  //
+  // freeze
+  //
+  // Returns an immutable copy of the set in a cache-friendly
+  // array layout, for sets that are built once and then only
+  // searched; see frozen_set.h for the layouts. Later changes to
+  // this set are not reflected in the copy.
+  //
+  template <typename Layout = eytzinger_layout>
+  frozen_set<TKey, Layout> freeze()
+  {
+    std::vector<TKey> V;
+    V.reserve(this->Size);
+
+    for (NODE *cur = (this->Root == nullptr) ? nullptr : _leftmost(this->Root);
+         cur != nullptr;
+         cur = _successor(cur))
+      V.push_back(cur->get_Key());
+
+    return frozen_set<TKey, Layout>(V);
+  }
+
+  //
+  // save / load
+  //
+  // save writes the keys, in order, to a stream or file descriptor
+  // in the format of set_codec.h; load replaces the contents of the
+  // set with keys written by save. TKey needs a set_codec.
+  //
+  // Since the keys come back sorted, load builds the tree in O(n),
+  // like insert_batch does for a large batch, rather than calling
+  // insert n times, and puts the nodes in one block in sorted order,
+  // as compact() does. If the input is not a saved set, or is cut
+  // short, std::runtime_error is thrown and the set is left as it
+  // was. The balancing mode, filter and cache are kept.
+  //
+  void save(std::ostream &out)
+  {
+    set_ostream_sink sink{out};
+    _save(sink);
+  }
+
+  void save(int fd)
+  {
+    set_fd_sink sink{fd};
+    _save(sink);
+  }
+
+  void load(std::istream &in)
+  {
+    set_istream_source source{in};
+    _load(source);
+  }
+
+  void load(int fd)
   {
-    std::vector<TKey> V;
+    set_fd_source source{fd};
+    _load(source);
+  }
 
-    _toVector(this->Root, V);
+private:
+  template <typename Sink>
+  void _save(Sink &sink)
+  {
+    set_codec_writer<TKey, Sink> writer(sink, this->Size);
 
-    return V;
+    this->for_each([&](const TKey &key) { writer.add(key); });
+
+    writer.finish();
+  }
+
+  template <typename Source>
+  void _load(Source &source)
+  {
+    set_codec_reader<TKey, Source> reader(source);
+
+    if (reader.count() > (unsigned long long)INT_MAX)
+      throw std::runtime_error("set::load: too many keys");
+
+    //
+    // the count comes from the input, so it is not trusted with a
+    // large allocation up front: the arena grows as keys arrive,
+    // doubling up to the count. Nothing points into it until every
+    // key is read, so it may reallocate until then:
+    //
+    std::shared_ptr<ARENA> arena = std::make_shared<ARENA>();
+    arena->Nodes.reserve(std::min(reader.count(), 1ULL << 16));
+
+    reader.for_each([&](const TKey &key) {
+      if (!arena->Nodes.empty() && !(arena->Nodes.back().get_Key() < key))
+        throw std::runtime_error("set::load: keys out of order");
+
+      if (arena->Nodes.size() == arena->Nodes.capacity())
+        arena->Nodes.reserve(std::min(reader.count(), 2ULL * arena->Nodes.capacity()));
+
+      arena->Nodes.emplace_back(key);
+    });
+
+    std::vector<NODE *> nodes;
+    nodes.reserve(arena->Nodes.size());
+
+    for (NODE &n : arena->Nodes)
+      nodes.push_back(&n);
+
+    //
+    // every key was read, so the old tree can go:
+    //
+    _destroy(this->Root);
+
+    if (this->Balance == set_balance::treap)
+      this->Root = _linkTreap(nodes, nullptr);
+    else
+      this->Root = _linkBalanced(nodes, nullptr);
+
+    this->Size = (int)nodes.size();
+    this->Arenas.clear();
+    this->Arenas.push_back(arena);
+
+    _clearCache();
+
+    if (this->Filter != nullptr)
+      _buildFilter(this->Filter->bitsPerKey());
   }
 
+public:
+
   //
   //
   // toPairs
@@ -368,6 +1833,8 @@ private:
   private:
     NODE *Ptr;
 
+    friend class set; // for hinted insert/find
+
   public:
     iterator(NODE *ptr)
         : Ptr(ptr)
@@ -451,28 +1918,530 @@ private:
 public:
   iterator find(TKey key)
   {
-    NODE *cur = this->Root;
+    return iterator(_lookup(key));
+  }
 
-    while (cur != nullptr)
+  //
+  // insert / find with a hint:
+  //
+  // hint should denote the element just before key, e.g. the
+  // element returned by the previous hinted insert when keys arrive
+  // in increasing order. If key equals the hint or its successor,
+  // or falls between the two, the operation completes in O(1) by
+  // following the hint's thread; otherwise (including when hint is
+  // set.end()) it falls back to a descent from the root. insert
+  // returns an iterator denoting key in the set; find returns
+  // set.end() if key is not in the set. In treap and scapegoat mode
+  // insert ignores the hint.
+  //
+  iterator insert(iterator hint, TKey key)
+  {
+    NODE *h = hint.Ptr;
+
+    //
+    // in treap mode the new node may have to rise above the hint,
+    // and in scapegoat mode its depth must be checked, so both take
+    // the path from the root:
+    //
+    if (this->Balance == set_balance::treap || this->Balance == set_balance::scapegoat)
+      h = nullptr;
+
+    if (h != nullptr && h->get_Key() < key)
     {
-      if (key < cur->get_Key())
-      { // search left:
-        cur = cur->get_Left();
+      NODE *s = _successor(h);
+
+      if (s == nullptr || key < s->get_Key())
+      { // key belongs right after the hint:
+        NODE *n = new NODE(key);
+
+        n->set_isThreaded(true);
+        n->set_Right(s);
+
+        _attachBetween(h, s, n);
+        this->Size++;
+        _filterAdd(key);
+
+        return iterator(n);
       }
-      else if (cur->get_Key() < key)
-      { // search right:
-        cur = cur->get_Right();
+      else if (!(s->get_Key() < key)) // equal to successor:
+        return iterator(s);
+    }
+    else if (h != nullptr && !(key < h->get_Key())) // equal to hint:
+      return hint;
+
+    int size = this->Size;
+    NODE *n = this->_insert(key);
+
+    if (this->Size != size)
+      _filterAdd(key);
+
+    return iterator(n);
+  }
+
+  iterator find(iterator hint, TKey key)
+  {
+    NODE *h = hint.Ptr;
+
+    if (h != nullptr && h->get_Key() < key)
+    {
+      NODE *s = _successor(h);
+
+      if (s == nullptr || key < s->get_Key()) // would fall in between:
+        return iterator(nullptr);
+      else if (!(s->get_Key() < key)) // equal to successor:
+        return iterator(s);
+    }
+    else if (h != nullptr && !(key < h->get_Key())) // equal to hint:
+      return hint;
+
+    return this->find(key);
+  }
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first element that is not
+  // less than key, or set.end() if there is no such element.
+  //
+  iterator lower_bound(TKey key)
+  {
+    return iterator(_lowerBound(this->Root, key));
+  }
+
+  //
+  // intersect:
+  //
+  // Returns a new set containing the keys found in both this set
+  // and other. The smaller set is walked in order via its threads;
+  // when the sizes are close the larger set is walked alongside it
+  // (a linear merge), otherwise each key is located in the larger
+  // set by galloping from the previous match: a walk along the
+  // threads of up to 1, 2, 4, ... steps, the budget doubling while
+  // walks keep reaching the key, and otherwise a finger descent
+  // (see _fingerLowerBound) that starts at the deepest ancestor of
+  // the previous match not less than key. A key d places further on
+  // costs about log d, so a 1K x 50M intersection is ~1K short
+  // descents instead of a 50M walk.
+  //
+  set intersect(const set &other) const
+  {
+    const set *small = this;
+    const set *large = &other;
+
+    if (large->Size < small->Size)
+      std::swap(small, large);
+
+    std::vector<TKey> common;
+
+    if (small->Root == nullptr)
+      return set();
+
+    NODE *s = _leftmost(small->Root);
+    NODE *l = nullptr;
+    std::vector<NODE *> finger; // of the larger set
+    int budget = 1;
+    bool merge = (long long)large->Size <= (long long)small->Size * MERGE_RATIO;
+
+    if (merge)
+      l = (large->Root == nullptr) ? nullptr : _leftmost(large->Root);
+
+    for (; s != nullptr; s = _successor(s))
+    {
+      const TKey &key = s->get_Key();
+
+      if (merge)
+      {
+        while (l != nullptr && l->get_Key() < key)
+          l = _successor(l);
       }
       else
-      { // must be equal, found it!
-        return iterator(cur);
+      {
+        //
+        // gallop: walk up to budget threads from the last position,
+        // then descend from the finger:
+        //
+        int steps = 0;
+        while (l != nullptr && l->get_Key() < key && steps < budget)
+        {
+          l = _successor(l);
+          steps++;
+        }
+
+        if (l == nullptr ? steps == 0 : l->get_Key() < key)
+        {
+          l = _fingerLowerBound(large->Root, finger, key);
+          budget = 1;
+        }
+        else if (budget < GALLOP_STEPS)
+          budget *= 2;
       }
+
+      if (l == nullptr)
+        break; // nothing left in the larger set
+
+      if (!(key < l->get_Key())) // equal:
+        common.push_back(key);
     }
 
-    // if get here, not found
-    return iterator(nullptr);
+    set result;
+    result._buildSorted(common);
+
+    return result;
+  }
+
+  //
+  // split:
+  //
+  // Moves the keys of this set into two new sets: those less than
+  // key, and those greater than or equal to key. This set is left
+  // empty. The tree is cut along a single root-to-leaf path, so no
+  // nodes are copied; the only thread that crosses the cut -- the
+  // one out of the largest key of the left half -- is cleared.
+  // Restructuring costs O(depth); the sizes of the halves are found
+  // by walking both thread lists in lockstep until the shorter one
+  // ends, i.e. O(min(|left|, |right|)).
+  //
+private:
+  static void _split(NODE *cur, const PROBE &probe, NODE *&left, NODE *&right)
+  {
+    if (cur == nullptr)
+    {
+      left = nullptr;
+      right = nullptr;
+    }
+    else if (_compare(probe, cur) > 0)
+    {
+      //
+      // cur and its left subtree go left, its right subtree is cut:
+      //
+      NODE *l, *r;
+      bool threaded = cur->get_isThreaded();
+
+      _split(cur->get_Right(), probe, l, r);
+
+      if (!threaded)
+      {
+        cur->set_Right(l);
+        cur->set_isThreaded(l == nullptr); // if so, cur is the new max
+      }
+
+      left = cur;
+      right = r;
+    }
+    else
+    {
+      //
+      // cur and its right subtree go right, its left subtree is cut:
+      //
+      NODE *l, *r;
+
+      _split(cur->get_Left(), probe, l, r);
+      cur->set_Left(r);
+
+      left = l;
+      right = cur;
+    }
+  }
+
+  static NODE *_rightmost(NODE *cur)
+  {
+    while (cur->get_Right() != nullptr)
+      cur = cur->get_Right();
+
+    return cur;
+  }
+
+public:
+  std::pair<set, set> split(TKey key)
+  {
+    NODE *l, *r;
+
+    _split(this->Root, key, l, r);
+
+    if (l != nullptr) // the largest key on the left no longer has a successor:
+      _rightmost(l)->set_Right(nullptr);
+
+    //
+    // count the shorter half, the other gets the rest:
+    //
+    NODE *a = (l == nullptr) ? nullptr : _leftmost(l);
+    NODE *b = (r == nullptr) ? nullptr : _leftmost(r);
+    int count = 0;
+
+    while (a != nullptr && b != nullptr)
+    {
+      a = _successor(a);
+      b = _successor(b);
+      count++;
+    }
+
+    std::pair<set, set> halves;
+
+    halves.first.Root = l;
+    halves.second.Root = r;
+
+    halves.first.Arenas = this->Arenas; // both halves may use them
+    halves.second.Arenas = this->Arenas;
+
+    halves.first.Balance = this->Balance;
+    halves.second.Balance = this->Balance;
+
+    if (this->Filter != nullptr) // still correct for each half, if stale:
+    {
+      halves.first.Filter.reset(new bloom_filter<TKey>(*this->Filter));
+      halves.second.Filter = std::move(this->Filter);
+    }
+
+    if (!this->Cache.empty()) // same size, starting empty:
+    {
+      halves.first.Cache.assign(this->Cache.size(), CACHE_ENTRY{0, nullptr});
+      halves.second.Cache.assign(this->Cache.size(), CACHE_ENTRY{0, nullptr});
+      _clearCache();
+    }
+
+    if (a == nullptr)
+    {
+      halves.first.Size = count;
+      halves.second.Size = this->Size - count;
+    }
+    else
+    {
+      halves.first.Size = this->Size - count;
+      halves.second.Size = count;
+    }
+
+    this->Root = nullptr;
+    this->Size = 0;
+    this->Arenas.clear();
+
+    return halves;
+  }
+
+  //
+  // join:
+  //
+  // Moves every key of other into this set, leaving other empty.
+  // Every key of this set must be less than every key of other,
+  // otherwise std::invalid_argument is thrown and neither set is
+  // changed. The largest node of this set is unlinked and becomes
+  // the new root, with the two trees as its children, so the cost
+  // is O(depth) and no nodes are copied. In scapegoat mode the
+  // height is checked afterwards, in O(n); see _checkScapegoat.
+  //
+  void join(set &other)
+  {
+    if (this == &other || other.Root == nullptr)
+      return;
+
+    if (this->Root == nullptr)
+    {
+      std::swap(this->Root, other.Root);
+      std::swap(this->Size, other.Size);
+      _takeArenas(other);
+      _afterJoin(other);
+      _checkScapegoat(); // other's tree may not have been kept in shape
+      return;
+    }
+
+    if (this->Balance == set_balance::treap)
+    {
+      //
+      // merge the two treaps along their boundary:
+      //
+      NODE *max = _rightmost(this->Root);
+      NODE *min = _leftmost(other.Root);
+
+      if (!(max->get_Key() < min->get_Key()))
+        throw std::invalid_argument("set::join");
+
+      max->set_Right(min);
+      this->Root = _treapJoin(this->Root, other.Root);
+      this->Size += other.Size;
+
+      other.Root = nullptr;
+      other.Size = 0;
+      _takeArenas(other);
+      _afterJoin(other);
+      return;
+    }
+
+    //
+    // find the largest node m of this tree, and its parent:
+    //
+    NODE *parent = nullptr;
+    NODE *m = this->Root;
+
+    while (m->get_Right() != nullptr)
+    {
+      parent = m;
+      m = m->get_Right();
+    }
+
+    if (!(m->get_Key() < _leftmost(other.Root)->get_Key()))
+      throw std::invalid_argument("set::join");
+
+    //
+    // unlink m; its left subtree takes its place:
+    //
+    NODE *rest = this->Root;
+
+    if (parent == nullptr)
+      rest = m->get_Left();
+    else if (m->get_Left() != nullptr)
+      parent->set_Right(m->get_Left());
+    else
+    {
+      parent->set_isThreaded(true); // parent's successor is now m
+      parent->set_Right(m);
+    }
+
+    //
+    // m becomes the root, joining the two trees:
+    //
+    m->set_Left(rest);
+    m->set_isThreaded(false);
+    m->set_Right(other.Root);
+
+    this->Root = m;
+    this->Size += other.Size;
+
+    other.Root = nullptr;
+    other.Size = 0;
+    _takeArenas(other);
+    _afterJoin(other);
+    _checkScapegoat();
   }
 
+private:
+  //
+  // moves the arenas of other into this set, once each:
+  //
+  void _takeArenas(set &other)
+  {
+    for (auto &arena : other.Arenas)
+    {
+      if (std::find(this->Arenas.begin(), this->Arenas.end(), arena) == this->Arenas.end())
+        this->Arenas.push_back(arena);
+    }
+
+    other.Arenas.clear();
+  }
+
+  //
+  // after other's keys joined ours: our filter takes in other's,
+  // bit by bit if they have the same shape and by a rebuild if not;
+  // other's filter and cache are emptied along with other:
+  //
+  void _afterJoin(set &other)
+  {
+    other._clearCache();
+
+    if (this->Filter != nullptr)
+    {
+      if (other.Filter == nullptr || !this->Filter->merge(*other.Filter) || this->Filter->full())
+        _buildFilter(this->Filter->bitsPerKey());
+    }
+
+    if (other.Filter != nullptr)
+      other._buildFilter(other.Filter->bitsPerKey());
+  }
+
+public:
+
+  //
+  // erase_range:
+  //
+  // Removes every key k with lo <= k < hi, and returns the number
+  // of keys removed. The subrange is cut out of the tree with two
+  // splits, its nodes are freed in one pass along their threads,
+  // and the tree below lo is relinked to the tree at or above hi
+  // by giving the predecessor of lo the successor of hi. The cost
+  // is O(depth + k) for k removed keys, plus O(n) in scapegoat mode
+  // to check the height.
+  //
+  int erase_range(TKey lo, TKey hi)
+  {
+    if (!(lo < hi))
+      return 0;
+
+    NODE *below, *rest, *range, *above;
+
+    _split(this->Root, lo, below, rest);
+    _split(rest, hi, range, above);
+
+    //
+    // free the subrange in order; its last node is still threaded
+    // into the part above hi, so stop there:
+    //
+    int removed = 0;
+
+    if (range != nullptr)
+    {
+      NODE *last = _rightmost(range);
+      NODE *cur = _leftmost(range);
+      bool done = false;
+
+      while (!done)
+      {
+        NODE *next = _successor(cur);
+        done = (cur == last);
+
+        _free(cur);
+        removed++;
+
+        cur = next;
+      }
+    }
+
+    //
+    // relink what is left:
+    //
+    if (below == nullptr)
+      this->Root = above;
+    else if (this->Balance == set_balance::treap)
+    {
+      _rightmost(below)->set_Right((above == nullptr) ? nullptr : _leftmost(above));
+      this->Root = _treapJoin(below, above);
+    }
+    else
+    {
+      this->Root = below;
+      _attachRight(below, above);
+    }
+
+    this->Size -= removed;
+
+    if (removed > 0)
+      _clearCache();
+
+    _checkScapegoat();
+
+    return removed;
+  }
+
+private:
+  //
+  // hangs the tree above off the largest node of the tree below,
+  // whose keys must all be smaller; the largest node of below is
+  // threaded and has no right child, so this is always possible:
+  //
+  static void _attachRight(NODE *below, NODE *above)
+  {
+    NODE *m = _rightmost(below);
+
+    if (above == nullptr)
+    {
+      m->set_isThreaded(true);
+      m->set_Right(nullptr);
+    }
+    else
+    {
+      m->set_isThreaded(false);
+      m->set_Right(above);
+    }
+  }
+
+public:
   // begin:
   iterator begin()
   {
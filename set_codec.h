@@ -0,0 +1,420 @@
+/*set_codec.h*/
+
+//
+// Writing the keys of a set to a file or stream and reading them
+// back; see set::save and set::load.
+//
+// set_codec<TKey> turns one key into bytes and back. It is provided
+// for integers and floating point (their bytes, little-endian) and
+// for std::string (its characters); specialize it for other key
+// types, e.g.
+//
+//   template <>
+//   struct set_codec<Movie>
+//   {
+//     static constexpr bool enabled = true;
+//     static constexpr set_codec_kind kind = set_codec_kind::custom;
+//     static constexpr int size = 0; // bytes per key, 0 => varies
+//
+//     static void encode(const Movie &key, std::string &out);
+//     static Movie decode(const char *data, size_t n);
+//   };
+//
+// encode appends the bytes of key to out, and decode rebuilds a key
+// from the n bytes at data, which is exactly what encode wrote. A
+// variable-size key may take up to set_codec_format::MAX_KEY bytes.
+//
+// kind and size are written into the header, and load checks both,
+// so that e.g. keys saved from a set<int> are not read back as
+// floats or unsigned ints.
+//
+// The format is a header, then the keys in sorted order, split into
+// chunks:
+//
+//   "TBST" <version, u32> <key kind, u32> <key size, u32>
+//   <# of keys, u64>
+//   <# of bytes, u32> <keys> ... <0, u32>
+//
+// A key is its bytes if the codec's size is fixed, otherwise a
+// varint length followed by its bytes. No key is split between two
+// chunks, and the last chunk is empty, so a reader knows exactly how
+// many bytes to read and never reads past the end of the set (the
+// stream may hold more after it). Numbers in the header are
+// little-endian.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm> // std::reverse
+#include <cstring>   // std::memcpy
+#include <cerrno>
+#include <unistd.h> // ::read, ::write
+
+enum class set_codec_kind : unsigned
+{
+  custom,
+  unsigned_integer,
+  signed_integer,
+  floating,
+  string
+};
+
+template <typename TKey, typename = void>
+struct set_codec
+{
+  static constexpr bool enabled = false;
+};
+
+template <typename TKey>
+struct set_codec<TKey, typename std::enable_if<std::is_arithmetic<TKey>::value>::type>
+{
+  static constexpr bool enabled = true;
+  static constexpr set_codec_kind kind = std::is_floating_point<TKey>::value ? set_codec_kind::floating
+                                         : std::is_signed<TKey>::value      ? set_codec_kind::signed_integer
+                                                                            : set_codec_kind::unsigned_integer;
+  static constexpr int size = sizeof(TKey);
+
+  static void encode(const TKey &key, std::string &out)
+  {
+    char bytes[sizeof(TKey)];
+    std::memcpy(bytes, &key, sizeof(TKey));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse(bytes, bytes + sizeof(TKey));
+#endif
+
+    out.append(bytes, sizeof(TKey));
+  }
+
+  static TKey decode(const char *data, size_t)
+  {
+    char bytes[sizeof(TKey)];
+    std::memcpy(bytes, data, sizeof(TKey));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse(bytes, bytes + sizeof(TKey));
+#endif
+
+    TKey key;
+    std::memcpy(&key, bytes, sizeof(TKey));
+
+    return key;
+  }
+};
+
+template <>
+struct set_codec<std::string>
+{
+  static constexpr bool enabled = true;
+  static constexpr set_codec_kind kind = set_codec_kind::string;
+  static constexpr int size = 0;
+
+  static void encode(const std::string &key, std::string &out)
+  {
+    out.append(key);
+  }
+
+  static std::string decode(const char *data, size_t n)
+  {
+    return std::string(data, n);
+  }
+};
+
+// #################################################################
+//
+// Where the bytes go and come from: write(data, n) writes all n
+// bytes or throws, and read(data, n) reads exactly n bytes or
+// throws.
+//
+struct set_ostream_sink
+{
+  std::ostream &Out;
+
+  void write(const char *data, size_t n)
+  {
+    if (!this->Out.write(data, n))
+      throw std::runtime_error("set::save: write failed");
+  }
+};
+
+struct set_fd_sink
+{
+  int Fd;
+
+  void write(const char *data, size_t n)
+  {
+    while (n > 0)
+    {
+      ssize_t written = ::write(this->Fd, data, n);
+
+      if (written < 0 && errno == EINTR)
+        continue;
+      else if (written <= 0)
+        throw std::runtime_error("set::save: write failed");
+
+      data += written;
+      n -= written;
+    }
+  }
+};
+
+struct set_istream_source
+{
+  std::istream &In;
+
+  void read(char *data, size_t n)
+  {
+    if (!this->In.read(data, n))
+      throw std::runtime_error("set::load: unexpected end of input");
+  }
+};
+
+struct set_fd_source
+{
+  int Fd;
+
+  void read(char *data, size_t n)
+  {
+    while (n > 0)
+    {
+      ssize_t got = ::read(this->Fd, data, n);
+
+      if (got < 0 && errno == EINTR)
+        continue;
+      else if (got < 0)
+        throw std::runtime_error("set::load: read failed");
+      else if (got == 0)
+        throw std::runtime_error("set::load: unexpected end of input");
+
+      data += got;
+      n -= got;
+    }
+  }
+};
+
+// #################################################################
+//
+// The format itself:
+//
+struct set_codec_format
+{
+  static constexpr char MAGIC[4] = {'T', 'B', 'S', 'T'};
+  static constexpr unsigned VERSION = 2;      // 2 added the key kind
+  static constexpr size_t CHUNK = 1 << 20;    // bytes per chunk, about
+  static constexpr size_t MAX_KEY = 1 << 24;  // bytes of a variable-size key
+
+  // no chunk is longer, so a longer length means a corrupt input:
+  static constexpr size_t MAX_CHUNK = CHUNK + 10 + MAX_KEY;
+};
+
+inline void set_codec_put(std::string &out, unsigned long long n, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+    out.push_back((char)(n >> (8 * i)));
+}
+
+inline unsigned long long set_codec_get(const char *in, int bytes)
+{
+  unsigned long long n = 0;
+
+  for (int i = 0; i < bytes; i++)
+    n |= (unsigned long long)(unsigned char)in[i] << (8 * i);
+
+  return n;
+}
+
+//
+// set_codec_writer
+//
+// Writes count keys, passed to add() in sorted order, to sink;
+// finish() writes what is left and the end marker.
+//
+template <typename TKey, typename Sink>
+class set_codec_writer
+{
+  static_assert(set_codec<TKey>::enabled, "set::save: specialize set_codec<TKey> to save this key type");
+
+private:
+  typedef set_codec<TKey> CODEC;
+
+  Sink &Out;
+  std::string Buffer;  // the chunk being filled, after 4 bytes for its length
+  std::string Scratch; // one variable-size key
+
+  void _flush()
+  {
+    size_t n = this->Buffer.size() - 4;
+
+    for (int i = 0; i < 4; i++)
+      this->Buffer[i] = (char)(n >> (8 * i));
+
+    this->Out.write(this->Buffer.data(), this->Buffer.size());
+    this->Buffer.resize(4);
+  }
+
+public:
+  set_codec_writer(Sink &out, unsigned long long count)
+      : Out(out)
+  {
+    std::string header(set_codec_format::MAGIC, 4);
+    set_codec_put(header, set_codec_format::VERSION, 4);
+    set_codec_put(header, (unsigned)CODEC::kind, 4);
+    set_codec_put(header, CODEC::size, 4);
+    set_codec_put(header, count, 8);
+
+    this->Out.write(header.data(), header.size());
+
+    this->Buffer.reserve(set_codec_format::CHUNK + 64);
+    this->Buffer.resize(4);
+  }
+
+  void add(const TKey &key)
+  {
+    if (CODEC::size != 0)
+      CODEC::encode(key, this->Buffer);
+    else
+    {
+      this->Scratch.clear();
+      CODEC::encode(key, this->Scratch);
+
+      if (this->Scratch.size() > set_codec_format::MAX_KEY)
+        throw std::runtime_error("set::save: key too large");
+
+      for (size_t n = this->Scratch.size(); true; n >>= 7) // varint length:
+      {
+        if (n < 0x80)
+        {
+          this->Buffer.push_back((char)n);
+          break;
+        }
+        this->Buffer.push_back((char)(0x80 | (n & 0x7f)));
+      }
+
+      this->Buffer.append(this->Scratch);
+    }
+
+    if (this->Buffer.size() >= set_codec_format::CHUNK)
+      _flush();
+  }
+
+  void finish()
+  {
+    if (this->Buffer.size() > 4)
+      _flush();
+
+    _flush(); // empty => end
+  }
+};
+
+//
+// set_codec_reader
+//
+// Reads the header from source; for_each(f) then calls f(key) for
+// each of the count() keys, in the order they were written. Throws
+// std::runtime_error if the input is not in this format, is cut
+// short, or holds a different # of keys than the header says.
+//
+template <typename TKey, typename Source>
+class set_codec_reader
+{
+  static_assert(set_codec<TKey>::enabled, "set::load: specialize set_codec<TKey> to load this key type");
+
+private:
+  typedef set_codec<TKey> CODEC;
+
+  Source &In;
+  unsigned long long Count;
+
+  static void _fail(const char *what)
+  {
+    throw std::runtime_error(std::string("set::load: ") + what);
+  }
+
+public:
+  set_codec_reader(Source &in)
+      : In(in)
+  {
+    char header[24];
+    this->In.read(header, sizeof(header));
+
+    if (std::memcmp(header, set_codec_format::MAGIC, 4) != 0)
+      _fail("not a saved set");
+    if (set_codec_get(header + 4, 4) != set_codec_format::VERSION)
+      _fail("unknown version");
+    if (set_codec_get(header + 8, 4) != (unsigned)CODEC::kind ||
+        set_codec_get(header + 12, 4) != (unsigned long long)CODEC::size)
+      _fail("saved with a different key type");
+
+    this->Count = set_codec_get(header + 16, 8);
+  }
+
+  unsigned long long count() const
+  {
+    return this->Count;
+  }
+
+  template <typename F>
+  void for_each(F f)
+  {
+    std::string buffer;
+    unsigned long long seen = 0;
+
+    while (true)
+    {
+      char length[4];
+      this->In.read(length, 4);
+      size_t n = set_codec_get(length, 4);
+
+      if (n == 0)
+        break;
+      else if (n > set_codec_format::MAX_CHUNK)
+        _fail("corrupt chunk");
+
+      buffer.resize(n);
+      this->In.read(&buffer[0], n);
+
+      const char *pos = buffer.data();
+      const char *end = pos + n;
+
+      while (pos < end)
+      {
+        size_t bytes = CODEC::size;
+
+        if (bytes == 0) // varint length:
+        {
+          for (int shift = 0; true; shift += 7)
+          {
+            if (pos == end || shift > 63)
+              _fail("corrupt key length");
+
+            unsigned char b = (unsigned char)*pos++;
+            bytes |= (size_t)(b & 0x7f) << shift;
+
+            if (b < 0x80)
+              break;
+          }
+        }
+
+        if ((size_t)(end - pos) < bytes)
+          _fail("corrupt chunk");
+        if (seen == this->Count)
+          _fail("more keys than the header says");
+
+        f(CODEC::decode(pos, bytes));
+
+        pos += bytes;
+        seen++;
+      }
+    }
+
+    if (seen != this->Count)
+      _fail("fewer keys than the header says");
+  }
+};
@@ -0,0 +1,49 @@
+/*set_hash.h*/
+
+//
+// Hashing keys, for the parts of set that need a hash of the key
+// rather than an order: the Bloom filter, the lookup cache, treap
+// priorities, and persistent_set.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <functional>  // std::hash
+#include <type_traits> // std::void_t
+#include <utility>     // std::declval
+
+//
+// set_hashable<TKey> is true if std::hash<TKey> is usable; the
+// features above are only offered for such keys:
+//
+template <typename TKey, typename = void>
+struct set_hashable : std::false_type
+{
+};
+
+template <typename TKey>
+struct set_hashable<TKey, std::void_t<decltype(std::hash<TKey>{}(std::declval<const TKey &>()))>>
+    : std::true_type
+{
+};
+
+//
+// std::hash is the identity for integers, so it is mixed well
+// enough for any of its bits to be used:
+//
+template <typename TKey>
+unsigned long long set_hash(const TKey &key)
+{
+  unsigned long long h = std::hash<TKey>{}(key);
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
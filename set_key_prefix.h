@@ -0,0 +1,82 @@
+/*set_key_prefix.h*/
+
+//
+// Fixed-size key prefixes, used by set to compare keys without
+// reading them.
+//
+// A node of set<std::string> holds a std::string, whose characters
+// (past the first 15 or so) live in a separate heap block. Every
+// comparison in a descent therefore costs a second cache miss on
+// top of the one for the node itself. If the node also holds the
+// first 8 bytes of its key as an integer, most comparisons are
+// decided by that integer alone, and the characters are read only
+// when two prefixes tie.
+//
+// set_key_prefix<TKey>::of(key) must be order preserving: if
+// a < b then of(a) <= of(b). Equal prefixes say nothing, and the
+// full keys are compared. The default is disabled, in which case
+// nodes hold no prefix at all; specialize it to enable prefixes for
+// other key types (e.g. a struct whose first field is a string, or
+// URLs with the common "https://" stripped off).
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <string>
+
+template <typename TKey>
+struct set_key_prefix
+{
+  static constexpr bool enabled = false;
+
+  static unsigned long long of(const TKey &)
+  {
+    return 0;
+  }
+};
+
+//
+// strings compare as unsigned chars, so the first 8 chars packed
+// big-endian (short strings padded with 0) compare the same way:
+//
+template <>
+struct set_key_prefix<std::string>
+{
+  static constexpr bool enabled = true;
+
+  static unsigned long long of(const std::string &key)
+  {
+    unsigned long long prefix = 0;
+    size_t n = key.size() < 8 ? key.size() : 8;
+
+    for (size_t i = 0; i < n; i++)
+      prefix |= (unsigned long long)(unsigned char)key[i] << (56 - 8 * i);
+
+    return prefix;
+  }
+};
+
+//
+// the prefix as stored in a node; takes no space when disabled:
+//
+template <typename TKey, bool Enabled = set_key_prefix<TKey>::enabled>
+class set_key_prefix_field
+{
+private:
+  unsigned long long Prefix;
+
+public:
+  unsigned long long get_Prefix() { return this->Prefix; }
+  void set_Prefix(const TKey &key) { this->Prefix = set_key_prefix<TKey>::of(key); }
+};
+
+template <typename TKey>
+class set_key_prefix_field<TKey, false>
+{
+public:
+  unsigned long long get_Prefix() { return 0; }
+  void set_Prefix(const TKey &) {}
+};
@@ -0,0 +1,256 @@
+/*simd_search.h*/
+
+//
+// Searching a short sorted array of keys, as found in a wide tree
+// node (see btree_set.h).
+//
+// simd_search<TKey>::lower_bound(keys, count, key) returns the index
+// of the first key not less than key, and upper_bound the index of
+// the first key greater than key. Since the keys are sorted, each
+// is just a count of the keys on one side of key, so for int, long
+// long and double the whole node is compared at once with SSE/AVX2
+// compares, and the counts are read off the resulting bit masks.
+// Every other TKey gets a scalar binary search.
+//
+// The vector code is compiled per function with target attributes,
+// so the program itself does not need -mavx2; the first call picks
+// the AVX2, SSE4.2 or scalar version based on the CPU it runs on.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SEARCH_X86 1
+#else
+#define SIMD_SEARCH_X86 0
+#endif
+
+// #################################################################
+//
+// scalar version, for every TKey:
+//
+template <typename TKey>
+struct simd_search
+{
+  static constexpr bool vectorized = false;
+
+  static int lower_bound(TKey *keys, int count, TKey &key)
+  {
+    int lo = 0, hi = count;
+
+    while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (keys[mid] < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    return lo;
+  }
+
+  static int upper_bound(TKey *keys, int count, TKey &key)
+  {
+    int lo = 0, hi = count;
+
+    while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (key < keys[mid])
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+    return lo;
+  }
+};
+
+#if SIMD_SEARCH_X86
+
+// #################################################################
+//
+// counting kernels: # of keys less than key (strict) or less than
+// or equal to key (!strict). Tails shorter than a vector are
+// counted one key at a time.
+//
+namespace simd_search_detail
+{
+  template <typename T>
+  int count_scalar(const T *keys, int count, T key, bool strict)
+  {
+    int n = 0;
+
+    for (int i = 0; i < count; i++)
+      n += strict ? (keys[i] < key) : !(key < keys[i]);
+
+    return n;
+  }
+
+  // int:
+  __attribute__((target("avx2"))) inline int count_avx2(const int *keys, int count, int key, bool strict)
+  {
+    __m256i k = _mm256_set1_epi32(key);
+    int n = 0, i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+      __m256i m = strict ? _mm256_cmpgt_epi32(k, v) // v < key, else v <= key:
+                         : _mm256_xor_si256(_mm256_cmpgt_epi32(v, k), _mm256_set1_epi32(-1));
+      n += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+    }
+
+    return n + count_scalar(keys + i, count - i, key, strict);
+  }
+
+  __attribute__((target("sse4.2"))) inline int count_sse(const int *keys, int count, int key, bool strict)
+  {
+    __m128i k = _mm_set1_epi32(key);
+    int n = 0, i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+      __m128i m = strict ? _mm_cmpgt_epi32(k, v)
+                         : _mm_xor_si128(_mm_cmpgt_epi32(v, k), _mm_set1_epi32(-1));
+      n += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+    }
+
+    return n + count_scalar(keys + i, count - i, key, strict);
+  }
+
+  // long long:
+  __attribute__((target("avx2"))) inline int count_avx2(const long long *keys, int count, long long key, bool strict)
+  {
+    __m256i k = _mm256_set1_epi64x(key);
+    int n = 0, i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+      __m256i m = strict ? _mm256_cmpgt_epi64(k, v)
+                         : _mm256_xor_si256(_mm256_cmpgt_epi64(v, k), _mm256_set1_epi64x(-1));
+      n += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+    }
+
+    return n + count_scalar(keys + i, count - i, key, strict);
+  }
+
+  __attribute__((target("sse4.2"))) inline int count_sse(const long long *keys, int count, long long key, bool strict)
+  {
+    __m128i k = _mm_set1_epi64x(key);
+    int n = 0, i = 0;
+
+    for (; i + 2 <= count; i += 2)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+      __m128i m = strict ? _mm_cmpgt_epi64(k, v)
+                         : _mm_xor_si128(_mm_cmpgt_epi64(v, k), _mm_set1_epi64x(-1));
+      n += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(m)));
+    }
+
+    return n + count_scalar(keys + i, count - i, key, strict);
+  }
+
+  // double:
+  __attribute__((target("avx2"))) inline int count_avx2(const double *keys, int count, double key, bool strict)
+  {
+    __m256d k = _mm256_set1_pd(key);
+    int n = 0, i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+      __m256d v = _mm256_loadu_pd(keys + i);
+      __m256d m = strict ? _mm256_cmp_pd(v, k, _CMP_LT_OQ) : _mm256_cmp_pd(v, k, _CMP_LE_OQ);
+      n += __builtin_popcount(_mm256_movemask_pd(m));
+    }
+
+    return n + count_scalar(keys + i, count - i, key, strict);
+  }
+
+  __attribute__((target("sse4.2"))) inline int count_sse(const double *keys, int count, double key, bool strict)
+  {
+    __m128d k = _mm_set1_pd(key);
+    int n = 0, i = 0;
+
+    for (; i + 2 <= count; i += 2)
+    {
+      __m128d v = _mm_loadu_pd(keys + i);
+      __m128d m = strict ? _mm_cmplt_pd(v, k) : _mm_cmple_pd(v, k);
+      n += __builtin_popcount(_mm_movemask_pd(m));
+    }
+
+    return n + count_scalar(keys + i, count - i, key, strict);
+  }
+
+  //
+  // picks the best kernel for this CPU, once:
+  //
+  template <typename T>
+  struct dispatch
+  {
+    typedef int (*KERNEL)(const T *, int, T, bool);
+
+    static KERNEL pick()
+    {
+      __builtin_cpu_init();
+
+      if (__builtin_cpu_supports("avx2"))
+        return static_cast<KERNEL>(&count_avx2);
+      else if (__builtin_cpu_supports("sse4.2"))
+        return static_cast<KERNEL>(&count_sse);
+      else
+        return &count_scalar<T>;
+    }
+
+    static int count(const T *keys, int count, T key, bool strict)
+    {
+      static const KERNEL kernel = pick();
+
+      return kernel(keys, count, key, strict);
+    }
+  };
+}
+
+// #################################################################
+//
+// vectorized versions:
+//
+template <typename T>
+struct simd_search_vector
+{
+  static constexpr bool vectorized = true;
+
+  static int lower_bound(T *keys, int count, T &key)
+  {
+    return simd_search_detail::dispatch<T>::count(keys, count, key, true);
+  }
+
+  static int upper_bound(T *keys, int count, T &key)
+  {
+    return simd_search_detail::dispatch<T>::count(keys, count, key, false);
+  }
+};
+
+template <>
+struct simd_search<int> : public simd_search_vector<int>
+{
+};
+
+template <>
+struct simd_search<long long> : public simd_search_vector<long long>
+{
+};
+
+template <>
+struct simd_search<double> : public simd_search_vector<double>
+{
+};
+
+#endif
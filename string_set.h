@@ -0,0 +1,414 @@
+/*string_set.h*/
+
+//
+// A set of strings, stored front-coded. Offers the interface of
+// set<std::string> (insert, contains, [], find, lower_bound,
+// begin/end, toVector, size), and every lookup also accepts a
+// std::string_view, so a probe need not be copied into a string.
+//
+// set<std::string> spends a node (links, thread bit, key prefix and
+// the std::string itself) plus a heap block for the characters on
+// every key, and sorted neighbours such as URLs repeat most of each
+// other's characters. Here the keys are kept in sorted order in
+// blocks of up to 2 * BLOCK_KEYS keys. A block is one byte string
+// in which each key is written as
+//
+//   <# of leading chars shared with the previous key> (varint)
+//   <# of chars that follow> (varint)
+//   <those chars>
+//
+// The first key of a block shares nothing, so it is written whole
+// and a lookup can binary search the blocks by their first keys
+// before scanning a single block. Per key this costs the distinct
+// suffix plus two or three bytes, and per block one std::string.
+//
+// Iterating decodes one key after another, the same walk in sorted
+// order that the threads provide in set. Iterators are invalidated
+// by insert.
+//
+// <<< Jay Yegon >>>
+// <<< COMPUTER SCIENCE AND ENGINEERING MAJOR >>>
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm> // std::sort, std::unique
+#include <stdexcept>
+
+class string_set
+{
+private:
+  // #################################################################
+  //
+  // blocks:
+  //
+  // A block is split in two when it grows past 2 * BLOCK_KEYS keys.
+  //
+  static const int BLOCK_KEYS = 32;
+
+  struct BLOCK
+  {
+    std::string Data; // the front-coded keys
+    int Count;        // # of keys in Data
+  };
+
+  std::vector<BLOCK> Blocks; // in order, none empty
+  int Size;                  // # of keys
+
+  //
+  // varint encoding, 7 bits per byte, low bits first:
+  //
+  static void _putVarint(std::string &out, size_t n)
+  {
+    while (n >= 0x80)
+    {
+      out.push_back((char)(0x80 | (n & 0x7f)));
+      n >>= 7;
+    }
+    out.push_back((char)n);
+  }
+
+  static size_t _getVarint(const std::string &in, size_t &pos)
+  {
+    size_t n = 0;
+    int shift = 0;
+
+    while (true)
+    {
+      unsigned char b = (unsigned char)in[pos++];
+      n |= (size_t)(b & 0x7f) << shift;
+
+      if (b < 0x80)
+        return n;
+
+      shift += 7;
+    }
+  }
+
+  //
+  // decodes the key at pos into key, which must hold the previous
+  // key of the block, and advances pos past it:
+  //
+  static void _next(const std::string &data, size_t &pos, std::string &key)
+  {
+    size_t shared = _getVarint(data, pos);
+    size_t rest = _getVarint(data, pos);
+
+    key.resize(shared);
+    key.append(data, pos, rest);
+    pos += rest;
+  }
+
+  //
+  // the first key of a block, without copying it:
+  //
+  static std::string_view _head(const BLOCK &block)
+  {
+    size_t pos = 0;
+    _getVarint(block.Data, pos); // shared, always 0
+    size_t n = _getVarint(block.Data, pos);
+
+    return std::string_view(block.Data.data() + pos, n);
+  }
+
+  static BLOCK _encode(const std::vector<std::string> &keys, size_t from, size_t to)
+  {
+    BLOCK block;
+    block.Count = (int)(to - from);
+
+    for (size_t i = from; i < to; i++)
+    {
+      size_t shared = 0;
+
+      if (i > from)
+      {
+        const std::string &prev = keys[i - 1];
+        size_t max = std::min(prev.size(), keys[i].size());
+
+        while (shared < max && prev[shared] == keys[i][shared])
+          shared++;
+      }
+
+      _putVarint(block.Data, shared);
+      _putVarint(block.Data, keys[i].size() - shared);
+      block.Data.append(keys[i], shared, std::string::npos);
+    }
+
+    block.Data.shrink_to_fit();
+
+    return block;
+  }
+
+  static std::vector<std::string> _decode(const BLOCK &block)
+  {
+    std::vector<std::string> keys;
+    std::string key;
+    size_t pos = 0;
+
+    for (int i = 0; i < block.Count; i++)
+    {
+      _next(block.Data, pos, key);
+      keys.push_back(key);
+    }
+
+    return keys;
+  }
+
+  //
+  // the block that would hold key: the last one whose first key is
+  // not greater than key, or block 0:
+  //
+  size_t _findBlock(std::string_view key) const
+  {
+    size_t lo = 0, hi = this->Blocks.size();
+
+    while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+
+      if (key < _head(this->Blocks[mid]))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+    return (lo == 0) ? 0 : lo - 1;
+  }
+
+public:
+  //
+  // default constructor:
+  //
+  string_set()
+      : Size(0)
+  {
+  }
+
+  //
+  // constructor:
+  //
+  // Builds the set from keys in any order, with duplicates allowed,
+  // e.g. the output of set<std::string>::toVector(). Blocks are
+  // filled to BLOCK_KEYS, leaving room for inserts.
+  //
+  string_set(std::vector<std::string> keys)
+      : Size(0)
+  {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    for (size_t i = 0; i < keys.size(); i += BLOCK_KEYS)
+      this->Blocks.push_back(_encode(keys, i, std::min(i + BLOCK_KEYS, keys.size())));
+
+    this->Size = (int)keys.size();
+  }
+
+  //
+  // size
+  //
+  // Returns # of elements in the set
+  //
+  int size() const
+  {
+    return this->Size;
+  }
+
+  //
+  // bytes
+  //
+  // Returns the # of bytes the set has allocated for its blocks.
+  //
+  size_t bytes() const
+  {
+    size_t n = this->Blocks.capacity() * sizeof(BLOCK);
+
+    for (const BLOCK &block : this->Blocks)
+      n += block.Data.capacity();
+
+    return n;
+  }
+
+  //
+  // insert
+  //
+  // Inserts the given key into the set; if the key is already in
+  // the set then this function has no effect. Costs a decode and
+  // re-encode of one block.
+  //
+  void insert(std::string_view key)
+  {
+    if (this->Blocks.empty())
+    {
+      this->Blocks.push_back(_encode({std::string(key)}, 0, 1));
+      this->Size++;
+      return;
+    }
+
+    size_t b = _findBlock(key);
+    std::vector<std::string> keys = _decode(this->Blocks[b]);
+
+    auto pos = std::lower_bound(keys.begin(), keys.end(), key,
+                                [](const std::string &k, std::string_view key) { return k < key; });
+
+    if (pos != keys.end() && *pos == key)
+      return; // already present
+
+    keys.insert(pos, std::string(key));
+    this->Size++;
+
+    if ((int)keys.size() <= 2 * BLOCK_KEYS)
+      this->Blocks[b] = _encode(keys, 0, keys.size());
+    else
+    { // split in half:
+      size_t half = keys.size() / 2;
+
+      this->Blocks[b] = _encode(keys, 0, half);
+      this->Blocks.insert(this->Blocks.begin() + b + 1, _encode(keys, half, keys.size()));
+    }
+  }
+
+  // #################################################################
+  //
+  // class iterator:
+  //
+  // Holds the current key, decoded, and where the next one starts.
+  //
+  class iterator
+  {
+  private:
+    const string_set *Set;
+    size_t Block; // == # of blocks => end
+    size_t Pos;   // offset of the next key in the block
+    int Index;    // # of the current key in the block
+    std::string Key;
+
+    friend class string_set;
+
+    iterator(const string_set *set, size_t block)
+        : Set(set), Block(block), Pos(0), Index(0)
+    {
+      if (this->Block < this->Set->Blocks.size())
+        _next(this->Set->Blocks[this->Block].Data, this->Pos, this->Key);
+    }
+
+  public:
+    std::string operator*() const
+    {
+      if (this->Block >= this->Set->Blocks.size())
+        throw std::out_of_range("string_set::iterator:operator*");
+
+      return this->Key;
+    }
+
+    bool operator==(const iterator &other) const
+    {
+      return this->Block == other.Block && this->Index == other.Index;
+    }
+
+    bool operator!=(const iterator &other) const
+    {
+      return !(*this == other);
+    }
+
+    void operator++()
+    {
+      if (this->Block >= this->Set->Blocks.size())
+        return;
+
+      this->Index++;
+
+      if (this->Index < this->Set->Blocks[this->Block].Count)
+        _next(this->Set->Blocks[this->Block].Data, this->Pos, this->Key);
+      else
+      { // first key of the next block, if any:
+        this->Block++;
+        this->Pos = 0;
+        this->Index = 0;
+
+        if (this->Block < this->Set->Blocks.size())
+          _next(this->Set->Blocks[this->Block].Data, this->Pos, this->Key);
+      }
+    }
+  };
+
+  //
+  // lower_bound:
+  //
+  // Returns an iterator denoting the first key not less than key,
+  // or end() if there is none.
+  //
+  iterator lower_bound(std::string_view key) const
+  {
+    if (this->Blocks.empty())
+      return this->end();
+
+    iterator iter(this, _findBlock(key));
+
+    while (iter != this->end() && std::string_view(iter.Key) < key)
+      ++iter;
+
+    return iter;
+  }
+
+  //
+  // find:
+  //
+  // Returns an iterator denoting key, or end() if not found.
+  //
+  iterator find(std::string_view key) const
+  {
+    iterator iter = this->lower_bound(key);
+
+    if (iter != this->end() && std::string_view(iter.Key) == key)
+      return iter;
+    else
+      return this->end();
+  }
+
+  //
+  // contains
+  //
+  // Returns true if set contains key, false if not
+  //
+  bool contains(std::string_view key) const
+  {
+    return this->find(key) != this->end();
+  }
+
+  bool operator[](std::string_view key) const
+  {
+    return this->contains(key);
+  }
+
+  iterator begin() const
+  {
+    return iterator(this, 0);
+  }
+
+  iterator end() const
+  {
+    return iterator(this, this->Blocks.size());
+  }
+
+  //
+  // toVector
+  //
+  // Returns the elements of the set, in order, in a vector.
+  //
+  std::vector<std::string> toVector() const
+  {
+    std::vector<std::string> V;
+    V.reserve(this->Size);
+
+    for (const BLOCK &block : this->Blocks)
+    {
+      std::vector<std::string> keys = _decode(block);
+      V.insert(V.end(), keys.begin(), keys.end());
+    }
+
+    return V;
+  }
+};
@@ -15,14 +15,25 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <iterator>
 #include <random>
 #include <set>  // for comparing answers
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <cstdio> // std::tmpfile
 
 using std::string;
 using std::vector;
 using std::pair;
 
 #include "set.h"
+#include "btree_set.h"
+#include "string_set.h"
+#include "radix_set.h"
+#include "persistent_set.h"
+#include "mapped_set.h"
+#include "compressed_set.h"
 #include "gtest/gtest.h"
 
 
@@ -782,4 +793,1911 @@ TEST(myset, test_advancing_iterator_beyond_size_of_Set)
   ASSERT_TRUE(*iterMid == 70); // ninth element
   iterMid.operator++(); // advance iterator past ninth element
   ASSERT_TRUE(iterMid == S2.end()); //hits end
-}
\ No newline at end of file
+}
+//
+// intersect sets of similar size (linear merge) and of very
+// different size (galloping), comparing against std::set_intersection
+//
+TEST(myset, intersect)
+{
+  set<int> A, B, Empty;
+  std::set<int> CA, CB;
+
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<int> distrib(1, 20000);
+
+  for (int i = 0; i < 5000; i++)
+  {
+    int x = distrib(gen);
+    A.insert(x);
+    CA.insert(x);
+  }
+  for (int i = 0; i < 50; i++) // much smaller => gallops
+  {
+    int x = distrib(gen);
+    B.insert(x);
+    CB.insert(x);
+  }
+
+  vector<int> expected;
+  std::set_intersection(CA.begin(), CA.end(), CB.begin(), CB.end(), std::back_inserter(expected));
+
+  set<int> R1 = A.intersect(B);
+  set<int> R2 = B.intersect(A);
+
+  ASSERT_EQ(R1.size(), (int) expected.size());
+  ASSERT_EQ(R1.toVector(), expected);
+  ASSERT_EQ(R2.toVector(), expected);
+
+  // similar sizes => merges:
+  set<int> R3 = A.intersect(A);
+  ASSERT_EQ(R3.size(), A.size());
+  ASSERT_EQ(R3.toVector(), A.toVector());
+
+  ASSERT_EQ(A.intersect(Empty).size(), 0);
+  ASSERT_EQ(Empty.intersect(A).size(), 0);
+
+  // runs of adjacent keys (thread walks, the budget doubling) between
+  // long jumps (finger descents), and a key past the end:
+  set<int> Runs;
+  vector<int> expectedRuns;
+  for (int start = 7; start < 20000; start += 3001)
+  {
+    for (int x = start; x < start + 40; x++)
+    {
+      Runs.insert(x);
+      if (CA.count(x) > 0)
+        expectedRuns.push_back(x);
+    }
+  }
+  Runs.insert(30000);
+
+  ASSERT_EQ(A.intersect(Runs).toVector(), expectedRuns);
+  ASSERT_EQ(Runs.intersect(A).toVector(), expectedRuns);
+
+  // result is a proper threaded tree:
+  vector<int> walked;
+  for (auto iter = R1.begin(); iter != R1.end(); ++iter)
+    walked.push_back(*iter);
+  ASSERT_EQ(walked, expected);
+
+  auto iter = A.lower_bound(0);
+  ASSERT_EQ(*iter, *CA.begin());
+  ASSERT_TRUE(A.lower_bound(20001) == A.end());
+}
+
+//
+// walks the set with its iterator, which follows the threads:
+//
+template <typename TKey>
+vector<TKey> walk(set<TKey> &S)
+{
+  vector<TKey> V;
+
+  for (auto iter = S.begin(); iter != S.end(); ++iter)
+    V.push_back(*iter);
+
+  return V;
+}
+
+//
+// split at every interesting position, check both halves are
+// proper threaded sets, then join them back together
+//
+TEST(myset, split_and_join)
+{
+  vector<int> V = { 22, 11, 49, 3, 19, 35, 61, 30, 41 };
+  vector<int> sorted = V;
+  std::sort(sorted.begin(), sorted.end());
+
+  for (int key = 0; key <= 62; key++)
+  {
+    set<int> S;
+    for (auto x : V)
+      S.insert(x);
+
+    auto halves = S.split(key);
+
+    ASSERT_EQ(S.size(), 0);
+    ASSERT_TRUE(S.begin() == S.end());
+
+    auto cut = std::lower_bound(sorted.begin(), sorted.end(), key);
+    vector<int> lower(sorted.begin(), cut);
+    vector<int> upper(cut, sorted.end());
+
+    ASSERT_EQ(halves.first.size(), (int) lower.size());
+    ASSERT_EQ(halves.second.size(), (int) upper.size());
+    ASSERT_EQ(walk(halves.first), lower);
+    ASSERT_EQ(walk(halves.second), upper);
+    ASSERT_EQ(halves.first.toVector(), lower);
+    ASSERT_EQ(halves.second.toVector(), upper);
+
+    for (auto x : V)
+      ASSERT_EQ(halves.first.contains(x), x < key);
+
+    halves.first.join(halves.second);
+
+    ASSERT_EQ(halves.second.size(), 0);
+    ASSERT_EQ(halves.first.size(), (int) sorted.size());
+    ASSERT_EQ(walk(halves.first), sorted);
+    ASSERT_EQ(halves.first.toVector(), sorted);
+  }
+}
+
+TEST(myset, split_and_join_random)
+{
+  set<long long> S;
+  std::set<long long> C;
+
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<long long> distrib(1, 1000000);
+
+  while (S.size() != 20000)
+  {
+    long long x = distrib(gen);
+    S.insert(x);
+    C.insert(x);
+  }
+
+  auto halves = S.split(500000);
+
+  vector<long long> lower(C.begin(), C.lower_bound(500000));
+  vector<long long> upper(C.lower_bound(500000), C.end());
+
+  ASSERT_EQ(walk(halves.first), lower);
+  ASSERT_EQ(walk(halves.second), upper);
+
+  // keys overlap, so joining the other way round must fail:
+  ASSERT_THROW(halves.second.join(halves.first), std::invalid_argument);
+  ASSERT_EQ(halves.first.size(), (int) lower.size());
+  ASSERT_EQ(halves.second.size(), (int) upper.size());
+
+  // the halves keep working as sets:
+  halves.first.insert(0);
+  halves.second.insert(2000000);
+
+  set<long long> Empty;
+  halves.first.join(Empty);
+  Empty.join(halves.first);
+
+  Empty.join(halves.second);
+
+  vector<long long> all(C.begin(), C.end());
+  all.insert(all.begin(), 0);
+  all.push_back(2000000);
+
+  ASSERT_EQ(Empty.size(), (int) all.size());
+  ASSERT_EQ(walk(Empty), all);
+}
+
+//
+// erase ranges from a random set and compare against std::set
+//
+TEST(myset, erase_range)
+{
+  set<int> S;
+  std::set<int> C;
+
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<int> distrib(1, 100000);
+
+  while (S.size() != 5000)
+  {
+    int x = distrib(gen);
+    S.insert(x);
+    C.insert(x);
+  }
+
+  std::uniform_int_distribution<int> bounds(0, 100001);
+
+  for (int i = 0; i < 50; i++)
+  {
+    int lo = bounds(gen);
+    int hi = lo + bounds(gen) / 20;
+
+    int expected = std::distance(C.lower_bound(lo), C.lower_bound(hi));
+    C.erase(C.lower_bound(lo), C.lower_bound(hi));
+
+    ASSERT_EQ(S.erase_range(lo, hi), expected);
+    ASSERT_EQ(S.size(), (int) C.size());
+    ASSERT_EQ(S.toVector(), vector<int>(C.begin(), C.end()));
+    ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+  }
+
+  // empty and reversed ranges remove nothing:
+  ASSERT_EQ(S.erase_range(50, 50), 0);
+  ASSERT_EQ(S.erase_range(60, 50), 0);
+
+  // the set keeps working after erasing:
+  S.insert(-5);
+  ASSERT_TRUE(S.contains(-5));
+
+  ASSERT_EQ(S.erase_range(-10, 200000), (int) C.size() + 1);
+  ASSERT_EQ(S.size(), 0);
+  ASSERT_TRUE(S.begin() == S.end());
+}
+
+//
+// batch inserts: sorted and unsorted batches with duplicates, into
+// empty, small and large sets
+//
+TEST(myset, insert_batch)
+{
+  set<int> S;
+  std::set<int> C;
+
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<int> distrib(1, 100000);
+
+  // into an empty set (rebuild path), unsorted with duplicates:
+  vector<int> batch;
+  for (int i = 0; i < 3000; i++)
+    batch.push_back(distrib(gen));
+  batch.push_back(batch[0]);
+
+  S.insert_batch(batch.begin(), batch.end());
+  C.insert(batch.begin(), batch.end());
+
+  ASSERT_EQ(S.size(), (int) C.size());
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+
+  // smaller batches (finger path), some keys already present:
+  for (int round = 0; round < 20; round++)
+  {
+    batch.clear();
+    for (int i = 0; i < 100; i++)
+      batch.push_back(distrib(gen));
+    batch.push_back(*C.begin());
+    batch.push_back(*C.rbegin());
+    batch.push_back(0);
+    batch.push_back(100001 + round);
+    std::sort(batch.begin(), batch.end());
+
+    S.insert_batch(batch.begin(), batch.end());
+    C.insert(batch.begin(), batch.end());
+
+    ASSERT_EQ(S.size(), (int) C.size());
+    ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+    ASSERT_EQ(S.toVector(), vector<int>(C.begin(), C.end()));
+  }
+
+  for (auto x : C)
+    ASSERT_TRUE(S.contains(x));
+
+  // an empty batch has no effect:
+  S.insert_batch(batch.end(), batch.end());
+  ASSERT_EQ(S.size(), (int) C.size());
+
+  // a long sorted run appended at the end stays balanced enough
+  // to search, and the set still accepts single inserts:
+  vector<int> run;
+  for (int x = 200000; x < 201000; x++)
+    run.push_back(x);
+  S.insert_batch(run.begin(), run.end());
+  C.insert(run.begin(), run.end());
+  S.insert(150000);
+  C.insert(150000);
+
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+}
+
+TEST(myset, insert_batch_strings)
+{
+  set<string> S;
+  vector<string> batch = { "pear", "apple", "banana", "apple", "chocolate" };
+
+  S.insert("carmel");
+  S.insert("zucchini");
+  S.insert_batch(batch.begin(), batch.end());
+
+  vector<string> expected = { "apple", "banana", "carmel", "chocolate", "pear", "zucchini" };
+
+  ASSERT_EQ(S.size(), 6);
+  ASSERT_EQ(walk(S), expected);
+}
+
+//
+// hinted insert/find, with good hints (append in order) and
+// useless hints (end, far away)
+//
+TEST(myset, insert_and_find_with_hint)
+{
+  set<int> S;
+
+  auto hint = S.end();
+  for (int x = 0; x < 1000; x += 2) // appending: hint is always right
+    hint = S.insert(hint, x);
+
+  ASSERT_EQ(S.size(), 500);
+  ASSERT_EQ(*hint, 998);
+
+  // hint next to the key, key already present / absent:
+  auto iter = S.find(100);
+  ASSERT_EQ(*S.insert(iter, 100), 100);
+  ASSERT_EQ(*S.insert(iter, 102), 102);
+  ASSERT_EQ(*S.insert(iter, 101), 101);
+  ASSERT_EQ(S.size(), 501);
+
+  ASSERT_EQ(*S.find(iter, 100), 100);
+  ASSERT_EQ(*S.find(iter, 101), 101);
+  ASSERT_EQ(*S.find(iter, 102), 102);
+  ASSERT_TRUE(S.find(S.find(102), 103) == S.end());
+
+  // useless hints fall back to a normal insert/find:
+  ASSERT_EQ(*S.insert(S.end(), -7), -7);
+  ASSERT_EQ(*S.insert(S.find(998), 501), 501);
+  ASSERT_EQ(*S.find(S.find(998), 4), 4);
+  ASSERT_TRUE(S.find(S.end(), 5) == S.end());
+  ASSERT_TRUE(S.find(S.find(998), 5) == S.end());
+  ASSERT_EQ(*S.insert(S.find(998), 1001), 1001);
+
+  std::set<int> C;
+  for (int x = 0; x < 1000; x += 2)
+    C.insert(x);
+  C.insert({ 101, -7, 501, 1001 });
+
+  ASSERT_EQ(S.size(), (int) C.size());
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+}
+
+//
+// frozen sets of every small size (every tree shape), and a
+// larger random one, compared against the set they came from;
+// run for each layout
+//
+template <typename Layout>
+void check_frozen_small_sizes()
+{
+  for (int n = 0; n <= 70; n++)
+  {
+    set<int> S;
+    for (int x = 0; x < n; x++)
+      S.insert(x * 2 + 1); // odd keys 1..2n-1
+
+    frozen_set<int, Layout> F = S.template freeze<Layout>();
+
+    ASSERT_EQ(F.size(), n);
+    ASSERT_EQ(F.toVector(), S.toVector());
+
+    for (int key = 0; key <= 2 * n + 1; key++)
+    {
+      ASSERT_EQ(F.contains(key), S.contains(key));
+      ASSERT_EQ(F[key], S[key]);
+
+      auto iter = F.lower_bound(key);
+      if (key >= 2 * n)
+        ASSERT_TRUE(iter == F.end());
+      else
+        ASSERT_EQ(*iter, (key % 2 == 1) ? key : key + 1);
+
+      if (S.contains(key))
+        ASSERT_EQ(*F.find(key), key);
+      else
+        ASSERT_TRUE(F.find(key) == F.end());
+    }
+  }
+}
+
+template <typename Layout>
+void check_frozen_random()
+{
+  set<long long> S;
+  std::set<long long> C;
+
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<long long> distrib(1, 1000000);
+
+  while (S.size() != 50000)
+  {
+    long long x = distrib(gen);
+    S.insert(x);
+    C.insert(x);
+  }
+
+  frozen_set<long long, Layout> F = S.template freeze<Layout>();
+
+  vector<long long> walked;
+  for (auto iter = F.begin(); iter != F.end(); ++iter)
+    walked.push_back(*iter);
+  ASSERT_EQ(walked, vector<long long>(C.begin(), C.end()));
+
+  for (int i = 0; i < 10000; i++)
+  {
+    long long key = distrib(gen);
+    auto expected = C.lower_bound(key);
+    auto iter = F.lower_bound(key);
+
+    ASSERT_EQ(F.contains(key), C.count(key) == 1);
+    if (expected == C.end())
+      ASSERT_TRUE(iter == F.end());
+    else
+      ASSERT_EQ(*iter, *expected);
+  }
+
+  // the snapshot is independent of the set:
+  S.insert(0);
+  ASSERT_FALSE(F.contains(0));
+}
+
+TEST(frozen_set, small_sizes)
+{
+  check_frozen_small_sizes<eytzinger_layout>();
+  check_frozen_small_sizes<veb_layout>();
+  check_frozen_small_sizes<sorted_layout>();
+}
+
+TEST(frozen_set, random)
+{
+  check_frozen_random<eytzinger_layout>();
+  check_frozen_random<veb_layout>();
+  check_frozen_random<sorted_layout>();
+}
+
+//
+// the van Emde Boas slots must be a permutation that stores each
+// recursive top tree before its bottom trees; check the slots of
+// a 15-node tree against the order worked out by hand:
+//
+TEST(frozen_set, veb_slots)
+{
+  veb_layout L;
+  L.init(15);
+
+  // height 4 => top tree of 2 levels {1,2,3}, then bottom trees
+  // of 2 levels rooted at 4, 5, 6, 7:
+  vector<size_t> expected = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 };
+  vector<size_t> bfs = { 1, 2, 3, 4, 8, 9, 5, 10, 11, 6, 12, 13, 7, 14, 15 };
+
+  ASSERT_EQ(L.slots(), (size_t) 15);
+  for (size_t k = 0; k < bfs.size(); k++)
+    ASSERT_EQ(L.slot(bfs[k]), expected[k]);
+}
+
+TEST(frozen_set, strings)
+{
+  set<string> S;
+  S.insert("banana");
+  S.insert("apple");
+  S.insert("chocolate");
+  S.insert("pear");
+
+  frozen_set<string> F = S.freeze();
+
+  ASSERT_TRUE(F.contains("pear"));
+  ASSERT_TRUE(F["apple"]);
+  ASSERT_FALSE(F.contains("appl"));
+  ASSERT_EQ(*F.lower_bound("c"), "chocolate");
+  ASSERT_EQ(F.toVector(), S.toVector());
+}
+
+//
+// btree_set offers the same interface as set; compare against
+// std::set for narrow (8 keys), default and wide (64 keys) nodes
+//
+template <typename TSet>
+void check_btree_random(int N)
+{
+  TSet S;
+  std::set<long long> C;
+
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<long long> distrib(1, N * 10);
+
+  while (S.size() != N)
+  {
+    long long x = distrib(gen);
+    S.insert(x);
+    S.insert(x); // no duplicates
+    C.insert(x);
+  }
+
+  ASSERT_EQ(S.size(), (int) C.size());
+  ASSERT_EQ(S.toVector(), vector<long long>(C.begin(), C.end()));
+
+  vector<long long> walked;
+  for (auto iter = S.begin(); iter != S.end(); ++iter)
+    walked.push_back(*iter);
+  ASSERT_EQ(walked, vector<long long>(C.begin(), C.end()));
+
+  for (int i = 0; i < 10000; i++)
+  {
+    long long key = distrib(gen);
+    bool expected = C.count(key) == 1;
+
+    ASSERT_EQ(S.contains(key), expected);
+    ASSERT_EQ(S[key], expected);
+
+    if (expected)
+      ASSERT_EQ(*S.find(key), key);
+    else
+      ASSERT_TRUE(S.find(key) == S.end());
+
+    auto lb = C.lower_bound(key);
+    if (lb == C.end())
+      ASSERT_TRUE(S.lower_bound(key) == S.end());
+    else
+      ASSERT_EQ(*S.lower_bound(key), *lb);
+  }
+
+  // copies are independent:
+  {
+    TSet S2 = S;
+    S2.insert(-1);
+    ASSERT_EQ(S2.size(), N + 1);
+    ASSERT_FALSE(S.contains(-1));
+  }
+  ASSERT_EQ(S.size(), N);
+}
+
+TEST(btree_set, random)
+{
+  check_btree_random<btree_set<long long, 8>>(20000);
+  check_btree_random<btree_set<long long>>(100000);
+  check_btree_random<btree_set<long long, 4096>>(100000);
+}
+
+TEST(btree_set, empty_and_strings)
+{
+  btree_set<string> S;
+
+  ASSERT_EQ(S.size(), 0);
+  ASSERT_TRUE(S.begin() == S.end());
+  ASSERT_FALSE(S.contains("apple"));
+  ASSERT_TRUE(S.find("apple") == S.end());
+
+  S.insert("banana");
+  S.insert("apple");
+  S.insert("chocolate");
+  S.insert("pear");
+  S.insert("apple");
+
+  ASSERT_EQ(S.size(), 4);
+  ASSERT_TRUE(S["pear"]);
+  ASSERT_FALSE(S["carmel"]);
+
+  vector<string> expected = { "apple", "banana", "chocolate", "pear" };
+  ASSERT_EQ(S.toVector(), expected);
+}
+
+TEST(btree_set, copy_and_move)
+{
+  btree_set<long long, 8> S, T, U;
+
+  for (long long i = 0; i < 1000; i++)
+    S.insert(i * 7);
+  T.insert(-1);
+
+  T = S; // T's old nodes are freed, S's copied
+  ASSERT_EQ(T.toVector(), S.toVector());
+
+  T.insert(-1);
+  ASSERT_EQ(T.size(), S.size() + 1);
+  ASSERT_FALSE(S.contains(-1));
+
+  T = T;
+  ASSERT_EQ(T.size(), S.size() + 1);
+
+  U = std::move(T);
+  ASSERT_EQ(U.size(), S.size() + 1);
+  ASSERT_EQ(T.size(), 0);
+
+  btree_set<long long, 8> V(std::move(U));
+  ASSERT_EQ(V.size(), S.size() + 1);
+  ASSERT_EQ(U.size(), 0);
+  ASSERT_TRUE(U.begin() == U.end());
+}
+
+//
+// the vectorized in-node search must agree with the scalar one,
+// for every count (vector bodies and tails) and probe position
+//
+template <typename T>
+void check_simd_search()
+{
+  ASSERT_TRUE(simd_search<T>::vectorized);
+
+  __builtin_cpu_init();
+  bool sse = __builtin_cpu_supports("sse4.2");
+  bool avx2 = __builtin_cpu_supports("avx2");
+
+  //
+  // every length from empty through several whole vectors, each
+  // with every tail length:
+  //
+  vector<T> keys;
+  for (int i = 0; i < 70; i++)
+    keys.push_back((T) (i * 2 - 40)); // negatives too
+
+  for (int count = 0; count <= 70; count++)
+  {
+    for (int probe = -43; probe <= 100; probe++)
+    {
+      T key = (T) probe;
+
+      int lower = std::lower_bound(keys.begin(), keys.begin() + count, key) - keys.begin();
+      int upper = std::upper_bound(keys.begin(), keys.begin() + count, key) - keys.begin();
+
+      ASSERT_EQ(simd_search<T>::lower_bound(keys.data(), count, key), lower);
+      ASSERT_EQ(simd_search<T>::upper_bound(keys.data(), count, key), upper);
+
+      //
+      // the dispatch above only runs the best kernel for this CPU,
+      // so check each kernel the CPU can run, strict (lower_bound)
+      // and not (upper_bound):
+      //
+      using namespace simd_search_detail;
+
+      ASSERT_EQ(count_scalar(keys.data(), count, key, true), lower);
+      ASSERT_EQ(count_scalar(keys.data(), count, key, false), upper);
+
+      if (sse)
+      {
+        ASSERT_EQ(count_sse(keys.data(), count, key, true), lower);
+        ASSERT_EQ(count_sse(keys.data(), count, key, false), upper);
+      }
+
+      if (avx2)
+      {
+        ASSERT_EQ(count_avx2(keys.data(), count, key, true), lower);
+        ASSERT_EQ(count_avx2(keys.data(), count, key, false), upper);
+      }
+    }
+  }
+}
+
+TEST(simd_search, matches_scalar)
+{
+  check_simd_search<int>();
+  check_simd_search<long long>();
+  check_simd_search<double>();
+
+  ASSERT_FALSE(simd_search<string>::vectorized);
+
+  vector<string> keys = { "apple", "banana", "pear" };
+  string key = "carmel";
+  ASSERT_EQ(simd_search<string>::lower_bound(keys.data(), 3, key), 2);
+  ASSERT_EQ(simd_search<string>::upper_bound(keys.data(), 3, key), 2);
+}
+
+//
+// contains_batch must agree with contains, including for batches
+// smaller than the number of lanes and for an empty set
+//
+TEST(myset, contains_batch)
+{
+  set<int> S;
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<int> distrib(1, 20000);
+
+  vector<int> keys;
+  vector<unsigned long long> bits;
+
+  S.contains_batch(keys, bits);
+  ASSERT_EQ(bits.size(), (size_t) 0);
+
+  keys = { 1, 2, 3 };
+  S.contains_batch(keys, bits);
+  ASSERT_EQ(bits.size(), (size_t) 1);
+  ASSERT_EQ(bits[0], 0ULL);
+
+  for (int i = 0; i < 5000; i++)
+    S.insert(distrib(gen));
+
+  for (int n : { 0, 1, 5, 16, 17, 64, 65, 1000 })
+  {
+    keys.clear();
+    for (int i = 0; i < n; i++)
+      keys.push_back(distrib(gen));
+
+    bits.assign(3, ~0ULL); // stale contents must be cleared
+    S.contains_batch(keys, bits);
+
+    ASSERT_EQ(bits.size(), (size_t) (n + 63) / 64);
+    for (int i = 0; i < n; i++)
+      ASSERT_EQ((bool) ((bits[i / 64] >> (i % 64)) & 1), S.contains(keys[i]));
+  }
+}
+
+//
+// for_each visits every key in order, with and without prefetch
+//
+TEST(myset, for_each)
+{
+  for (bool prefetch : { true, false })
+  {
+    set<int> S;
+    vector<int> V;
+
+    S.for_each([&](int x) { V.push_back(x); }, prefetch);
+    ASSERT_EQ(V.size(), (size_t) 0);
+
+    S.insert(5);
+    S.for_each([&](int x) { V.push_back(x); }, prefetch);
+    ASSERT_EQ(V, vector<int>({ 5 }));
+
+    for (int x : { 22, 11, 49, 3, 19, 35, 61, 30, 41 })
+      S.insert(x);
+
+    V.clear();
+    S.for_each([&](int x) { V.push_back(x); }, prefetch);
+    ASSERT_EQ(V, S.toVector());
+  }
+}
+
+//
+// compact keeps the contents, and the set keeps working afterwards:
+// inserts, erase_range, split/join and copies mixing compacted and
+// individually allocated nodes
+//
+TEST(myset, compact)
+{
+  set<int> S;
+  std::set<int> C;
+
+  S.compact(); // empty
+  ASSERT_EQ(S.size(), 0);
+  ASSERT_TRUE(S.begin() == S.end());
+
+  std::mt19937 gen(211);
+  std::uniform_int_distribution<int> distrib(1, 100000);
+
+  while (S.size() != 5000)
+  {
+    int x = distrib(gen);
+    S.insert(x);
+    C.insert(x);
+  }
+
+  vector<pair<int, int>> pairs = S.toPairs(-1);
+
+  S.compact();
+
+  ASSERT_EQ(S.size(), (int) C.size());
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+  ASSERT_EQ(S.toPairs(-1), pairs); // same shape, same threads
+
+  for (int i = 0; i < 1000; i++)
+  {
+    int x = distrib(gen);
+    ASSERT_EQ(S.contains(x), C.count(x) == 1);
+  }
+
+  // new nodes live outside the block:
+  for (int i = 0; i < 500; i++)
+  {
+    int x = distrib(gen);
+    S.insert(x);
+    C.insert(x);
+  }
+
+  S.erase_range(1000, 20000);
+  C.erase(C.lower_bound(1000), C.lower_bound(20000));
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+
+  // compacting again releases the first block:
+  S.compact();
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+
+  // both halves of a split share the block; each can be dropped or
+  // compacted on its own:
+  {
+    auto halves = S.split(50000);
+    halves.second.compact();
+    halves.first.insert(-1);
+
+    set<int> copy = halves.first;
+    halves.first.join(halves.second);
+
+    C.insert(-1);
+    ASSERT_EQ(walk(halves.first), vector<int>(C.begin(), C.end()));
+
+    S = std::move(halves.first);
+  }
+
+  ASSERT_EQ(S.size(), (int) C.size());
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+}
+
+TEST(myset, string_prefixes)
+{
+  // keys sharing 8+ chars, shorter than 8 chars, embedded '\0' and
+  // chars above 127, which must all order as std::string does:
+  vector<string> keys = {"", "a", "ab", string("a\0", 2), string("a\0b", 3),
+                         "https://", "https://a", "https://b.com/x", "https://b.com/y",
+                         "http", "zzzzzzzz", "zzzzzzzzz", "\xff", "\x7f\xff", "\x80"};
+
+  std::mt19937 gen(38);
+  std::uniform_int_distribution<int> len(0, 12), ch(0, 255);
+
+  for (int i = 0; i < 2000; i++)
+  {
+    string s = (i % 2 == 0) ? "https://" : "";
+    int n = len(gen);
+    for (int j = 0; j < n; j++)
+      s += (char)(ch(gen) % 4 == 0 ? ch(gen) : 'a' + ch(gen) % 3);
+    keys.push_back(s);
+  }
+
+  set<string> S;
+  std::set<string> C;
+
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    if (i % 2 == 0)
+    {
+      S.insert(keys[i]);
+      C.insert(keys[i]);
+    }
+  }
+
+  ASSERT_EQ(S.size(), (int)C.size());
+  ASSERT_EQ(S.toVector(), vector<string>(C.begin(), C.end()));
+
+  for (string &k : keys)
+  {
+    ASSERT_EQ(S.contains(k), C.count(k) == 1);
+    ASSERT_EQ(S.find(k) != S.end(), C.count(k) == 1);
+
+    auto iter = S.lower_bound(k);
+    auto expected = C.lower_bound(k);
+    if (expected == C.end())
+      ASSERT_TRUE(iter == S.end());
+    else
+      ASSERT_EQ(*iter, *expected);
+  }
+}
+
+TEST(string_set, random)
+{
+  // URL-like keys, so neighbours share long prefixes:
+  std::mt19937 gen(39);
+  std::uniform_int_distribution<int> host(0, 40), path(0, 2000);
+
+  string_set S;
+  std::set<string> C;
+  vector<string> probes;
+
+  for (int i = 0; i < 5000; i++)
+  {
+    string k = "https://host" + std::to_string(host(gen)) + ".com/p/" + std::to_string(path(gen));
+    probes.push_back(k);
+
+    if (i % 2 == 0)
+    {
+      S.insert(k);
+      C.insert(k);
+    }
+  }
+  probes.push_back("");
+  probes.push_back("https://");
+  probes.push_back("zzz");
+
+  ASSERT_EQ(S.size(), (int)C.size());
+  ASSERT_EQ(S.toVector(), vector<string>(C.begin(), C.end()));
+
+  vector<string> walked;
+  for (auto iter = S.begin(); iter != S.end(); ++iter)
+    walked.push_back(*iter);
+  ASSERT_EQ(walked, vector<string>(C.begin(), C.end()));
+
+  for (string &k : probes)
+  {
+    std::string_view view(k);
+    ASSERT_EQ(S.contains(view), C.count(k) == 1);
+    ASSERT_EQ(S[k], C.count(k) == 1);
+
+    auto iter = S.lower_bound(view);
+    auto expected = C.lower_bound(k);
+    if (expected == C.end())
+      ASSERT_TRUE(iter == S.end());
+    else
+      ASSERT_EQ(*iter, *expected);
+
+    if (C.count(k) == 1)
+      ASSERT_EQ(*S.find(view), k);
+    else
+      ASSERT_TRUE(S.find(view) == S.end());
+  }
+
+  // bulk build from a set's keys, then keep inserting:
+  set<string> T;
+  for (string &k : probes)
+    T.insert(k);
+
+  string_set B(T.toVector());
+  ASSERT_EQ(B.toVector(), T.toVector());
+
+  B.insert("https://host7.com/new");
+  T.insert("https://host7.com/new");
+  ASSERT_EQ(B.toVector(), T.toVector());
+  ASSERT_EQ(B.size(), T.size());
+}
+
+TEST(string_set, empty)
+{
+  string_set S;
+
+  ASSERT_EQ(S.size(), 0);
+  ASSERT_FALSE(S.contains("a"));
+  ASSERT_TRUE(S.begin() == S.end());
+  ASSERT_TRUE(S.lower_bound("a") == S.end());
+  ASSERT_THROW(*S.begin(), std::out_of_range);
+
+  S.insert("");
+  ASSERT_TRUE(S.contains(""));
+  ASSERT_EQ(*S.begin(), "");
+  ASSERT_EQ(S.size(), 1);
+}
+
+//
+// radix_set offers the same interface as set; compare against
+// std::set for dense and sparse keys, including negative keys
+//
+template <typename TKey>
+void check_radix_random(TKey lo, TKey hi, int N)
+{
+  radix_set<TKey> S;
+  std::set<TKey> C;
+
+  std::mt19937_64 gen(40);
+  std::uniform_int_distribution<TKey> distrib(lo, hi);
+
+  for (int i = 0; i < N; i++)
+  {
+    TKey x = distrib(gen);
+    S.insert(x);
+    C.insert(x);
+  }
+  S.insert(lo);
+  C.insert(lo);
+
+  ASSERT_EQ(S.size(), (int)C.size());
+  ASSERT_EQ(S.toVector(), vector<TKey>(C.begin(), C.end()));
+
+  vector<TKey> walked;
+  for (auto iter = S.begin(); iter != S.end(); ++iter)
+    walked.push_back(*iter);
+  ASSERT_EQ(walked, vector<TKey>(C.begin(), C.end()));
+
+  for (int i = 0; i < N; i++)
+  {
+    TKey x = distrib(gen);
+    ASSERT_EQ(S.contains(x), C.count(x) == 1);
+    ASSERT_EQ(S.find(x) != S.end(), C.count(x) == 1);
+
+    auto iter = S.lower_bound(x);
+    auto expected = C.lower_bound(x);
+    if (expected == C.end())
+      ASSERT_TRUE(iter == S.end());
+    else
+    {
+      ASSERT_EQ(*iter, *expected);
+      ++iter;
+      ++expected;
+      if (expected == C.end())
+        ASSERT_TRUE(iter == S.end());
+      else
+        ASSERT_EQ(*iter, *expected);
+    }
+  }
+
+  radix_set<TKey> copy = S;
+  ASSERT_EQ(copy.toVector(), S.toVector());
+
+  // assignment frees the old nodes, and copies or takes the new:
+  radix_set<TKey> assigned;
+  assigned.insert(lo);
+  assigned = S;
+  ASSERT_EQ(assigned.toVector(), S.toVector());
+
+  radix_set<TKey> moved(std::move(copy));
+  ASSERT_EQ(moved.toVector(), S.toVector());
+  ASSERT_EQ(copy.size(), 0);
+
+  assigned = std::move(moved);
+  ASSERT_EQ(assigned.toVector(), S.toVector());
+  ASSERT_EQ(moved.size(), 0);
+}
+
+TEST(radix_set, random)
+{
+  check_radix_random<int>(-1000, 1000, 1000);
+  check_radix_random<int>(-2000000000, 2000000000, 20000);
+  check_radix_random<unsigned>(0, 50000, 20000);
+  check_radix_random<long long>(-(1LL << 62), 1LL << 62, 20000);
+  check_radix_random<unsigned long long>(~0ULL - 100, ~0ULL, 1000);
+  check_radix_random<short>(-32768, 32767, 5000);
+}
+
+// opting char out of radix_set:
+template <>
+struct set_use_radix<char> : std::false_type
+{
+};
+
+TEST(radix_set, empty_and_fast_set)
+{
+  radix_set<int> S;
+
+  ASSERT_EQ(S.size(), 0);
+  ASSERT_FALSE(S.contains(0));
+  ASSERT_TRUE(S.begin() == S.end());
+  ASSERT_TRUE(S.lower_bound(-5) == S.end());
+  ASSERT_THROW(*S.begin(), std::out_of_range);
+
+  ASSERT_TRUE((std::is_same<fast_set<int>, radix_set<int>>::value));
+  ASSERT_TRUE((std::is_same<fast_set<string>, set<string>>::value));
+  ASSERT_TRUE((std::is_same<fast_set<char>, set<char>>::value));
+  ASSERT_TRUE((std::is_same<fast_set<bool>, set<bool>>::value));
+
+  fast_set<bool> B;
+  B.insert(true);
+  B.insert(false);
+  ASSERT_EQ(B.size(), 2);
+  ASSERT_EQ(*B.begin(), false);
+}
+
+TEST(myset, bloom_filter)
+{
+  set<int> S;
+  std::set<int> C;
+
+  S.enable_filter(10);
+
+  std::mt19937 gen(41);
+  std::uniform_int_distribution<int> distrib(0, 1000000);
+
+  // plain, batch and hinted inserts, past the initial filter size:
+  for (int i = 0; i < 3000; i++)
+  {
+    int x = distrib(gen);
+    S.insert(x);
+    C.insert(x);
+  }
+
+  vector<int> batch;
+  for (int i = 0; i < 3000; i++)
+    batch.push_back(distrib(gen));
+  S.insert_batch(batch.begin(), batch.end());
+  C.insert(batch.begin(), batch.end());
+
+  for (int i = 0; i < 100; i++)
+  {
+    int x = distrib(gen);
+    S.insert(S.lower_bound(x), x);
+    C.insert(x);
+  }
+
+  for (int i = 0; i < 10000; i++)
+  {
+    int x = distrib(gen);
+    ASSERT_EQ(S.contains(x), C.count(x) == 1);
+    ASSERT_EQ(S.find(x) != S.end(), C.count(x) == 1);
+  }
+  for (int x : C)
+    ASSERT_TRUE(S[x]);
+
+  // the filter follows the keys through copy, split and join:
+  set<int> copy = S;
+  auto halves = copy.split(500000);
+  halves.second.insert(2000000);
+  halves.first.join(halves.second);
+
+  std::set<int> D = C;
+  D.insert(2000000);
+
+  for (int x : D)
+    ASSERT_TRUE(halves.first.contains(x));
+  ASSERT_EQ(walk(halves.first), vector<int>(D.begin(), D.end()));
+
+  // and through erase_range, with or without a rebuild:
+  S.erase_range(0, 500000);
+  C.erase(C.begin(), C.lower_bound(500000));
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (int i = 0; i < 10000; i++)
+    {
+      int x = distrib(gen);
+      ASSERT_EQ(S.contains(x), C.count(x) == 1);
+    }
+
+    S.rebuild_filter();
+  }
+
+  S.disable_filter();
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+}
+
+TEST(bloom_filter, false_positives)
+{
+  bloom_filter<long long> F(100000, 10);
+
+  for (long long i = 0; i < 100000; i++)
+    F.add(i * 7);
+
+  for (long long i = 0; i < 100000; i++)
+    ASSERT_TRUE(F.mayContain(i * 7));
+
+  int passed = 0;
+  for (long long i = 0; i < 100000; i++)
+    passed += F.mayContain(i * 7 + 1);
+
+  ASSERT_LT(passed, 3000); // about 1% expected
+  ASSERT_FALSE(F.full());
+}
+
+TEST(myset, lookup_cache)
+{
+  set<int> S;
+  std::set<int> C;
+
+  for (int i = 0; i < 20000; i += 2)
+  {
+    S.insert((i * 7919) % 20000);
+    C.insert((i * 7919) % 20000);
+  }
+
+  S.enable_cache(100); // rounded up to 128
+  S.enable_filter();
+
+  // repeated lookups of a few keys hit:
+  for (int round = 0; round < 10; round++)
+  {
+    for (int x = 0; x < 20; x++)
+    {
+      ASSERT_EQ(S.contains(x), C.count(x) == 1);
+      ASSERT_EQ(S.find(x) != S.end(), C.count(x) == 1);
+    }
+  }
+
+  ASSERT_EQ(S.cache_hits() + S.cache_misses(), 400u);
+  ASSERT_GE(S.cache_hits(), 150u);
+
+  // nodes freed or moved by erase_range, compact, split and join
+  // must not be returned from the cache:
+  S.erase_range(0, 10);
+  C.erase(C.begin(), C.lower_bound(10));
+  for (int x = 0; x < 20; x++)
+    ASSERT_EQ(S.contains(x), C.count(x) == 1);
+
+  S.compact();
+  for (int x = 0; x < 20; x++)
+  {
+    auto iter = S.find(x);
+    ASSERT_EQ(iter != S.end(), C.count(x) == 1);
+    if (iter != S.end())
+    {
+      ASSERT_EQ(*iter, x);
+    }
+  }
+
+  auto halves = S.split(15);
+  for (int x = 0; x < 20; x++)
+  {
+    ASSERT_FALSE(S.contains(x));
+    ASSERT_EQ(halves.first.contains(x), x < 15 && C.count(x) == 1);
+    ASSERT_EQ(halves.second.contains(x), x >= 15 && C.count(x) == 1);
+  }
+
+  halves.first.join(halves.second);
+  for (int x = 0; x < 20; x++)
+  {
+    ASSERT_EQ(halves.first.contains(x), C.count(x) == 1);
+    ASSERT_FALSE(halves.second.contains(x));
+  }
+  ASSERT_EQ(walk(halves.first), vector<int>(C.begin(), C.end()));
+
+  // a moved set keeps its cache, which still points at its nodes:
+  set<int> moved = std::move(halves.first);
+  for (int x = 0; x < 20; x++)
+    ASSERT_EQ(moved.contains(x), C.count(x) == 1);
+
+  // copy assignment gives the copy its own nodes and cache, and
+  // frees the nodes it had:
+  set<int> assigned;
+  assigned.insert(-1);
+  assigned = moved;
+  ASSERT_EQ(walk(assigned), vector<int>(C.begin(), C.end()));
+  for (int x = 0; x < 20; x++)
+    ASSERT_EQ(assigned.contains(x), C.count(x) == 1);
+
+  assigned.insert(-2);
+  ASSERT_FALSE(moved.contains(-2));
+
+  set<int> taken;
+  taken = std::move(assigned);
+  ASSERT_TRUE(taken.contains(-2));
+  ASSERT_EQ(assigned.size(), 0);
+
+  moved.disable_cache();
+  ASSERT_TRUE(moved.contains(*C.begin()));
+}
+
+TEST(myset, splay)
+{
+  set<int> S;
+  std::set<int> C;
+
+  S.balancing(set_balance::splay);
+  ASSERT_TRUE(S.balancing() == set_balance::splay);
+
+  std::mt19937 gen(43);
+  std::uniform_int_distribution<int> distrib(0, 5000);
+
+  // sorted inserts, which leave an unbalanced tree as a list:
+  for (int i = 0; i < 2000; i++)
+  {
+    S.insert(i * 3);
+    C.insert(i * 3);
+  }
+
+  // mixed inserts and lookups; threads must survive the rotations:
+  for (int i = 0; i < 5000; i++)
+  {
+    int x = distrib(gen);
+
+    if (i % 3 == 0)
+    {
+      S.insert(x);
+      C.insert(x);
+    }
+    else
+    {
+      ASSERT_EQ(S.contains(x), C.count(x) == 1);
+      ASSERT_EQ(S.find(x) != S.end(), C.count(x) == 1);
+    }
+
+    if (i % 500 == 0)
+    {
+      ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+    }
+  }
+
+  ASSERT_EQ(S.size(), (int)C.size());
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+  ASSERT_EQ(S.toVector(), vector<int>(C.begin(), C.end()));
+
+  // the rest of the set's operations still work on a splayed tree:
+  int x = *std::next(C.begin(), C.size() / 3);
+  S.contains(x);
+
+  auto halves = S.split(x);
+  ASSERT_TRUE(halves.first.balancing() == set_balance::splay);
+  ASSERT_FALSE(halves.first.contains(x));
+  ASSERT_TRUE(halves.second.contains(x));
+  halves.first.join(halves.second);
+  ASSERT_EQ(walk(halves.first), vector<int>(C.begin(), C.end()));
+}
+
+TEST(myset, scapegoat)
+{
+  set<int> S;
+  std::set<int> C;
+
+  // a list, from sorted inserts, is rebuilt on switching:
+  for (int i = 0; i < 1000; i++)
+  {
+    S.insert(i);
+    C.insert(i);
+  }
+  ASSERT_EQ(S.height(), 1000);
+
+  S.balancing(set_balance::scapegoat);
+  ASSERT_EQ(S.height(), 10);
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+
+  // sorted and random inserts stay within log base 1/0.7 of n:
+  std::mt19937 gen(44);
+  std::uniform_int_distribution<int> distrib(-50000, 50000);
+
+  for (int i = 0; i < 20000; i++)
+  {
+    int x = (i < 10000) ? 1000 + i : distrib(gen);
+    S.insert(x);
+    C.insert(x);
+
+    if (i % 100 == 0)
+    {
+      double limit = std::log((double)S.size()) / std::log(1 / 0.7);
+      ASSERT_LE(S.height(), (int)limit + 1);
+    }
+
+    if (i % 1000 == 0)
+    {
+      ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+    }
+  }
+
+  ASSERT_EQ(S.size(), (int)C.size());
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+  ASSERT_EQ(S.toVector(), vector<int>(C.begin(), C.end()));
+
+  for (int i = 0; i < 1000; i++)
+  {
+    int x = distrib(gen);
+    ASSERT_EQ(S.contains(x), C.count(x) == 1);
+  }
+}
+
+//
+// the operations that link or unlink whole subtrees, or start from
+// a hint, must keep to the scapegoat height limit too:
+//
+TEST(myset, scapegoat_bulk)
+{
+  auto within = [](set<int> &S) {
+    double limit = std::log((double)S.size()) / std::log(1 / 0.7);
+    return S.height() <= (int)limit + 1;
+  };
+
+  set<int> S;
+  std::set<int> C;
+  S.balancing(set_balance::scapegoat);
+
+  // appending with hints:
+  auto hint = S.end();
+  for (int i = 0; i < 20000; i++)
+  {
+    hint = S.insert(hint, i);
+    C.insert(i);
+  }
+  ASSERT_TRUE(within(S));
+
+  // small sorted batches, falling into gaps:
+  for (int b = 0; b < 20; b++)
+  {
+    vector<int> batch;
+    for (int i = 0; i < 500; i++)
+      batch.push_back(20000 + b * 1000 + i);
+
+    S.insert_batch(batch.begin(), batch.end());
+    C.insert(batch.begin(), batch.end());
+    ASSERT_TRUE(within(S));
+  }
+
+  // cutting ranges out:
+  for (int r = 0; r < 30; r++)
+  {
+    int lo = r * 1000 + 1, hi = r * 1000 + 11;
+    S.erase_range(lo, hi);
+    C.erase(C.lower_bound(lo), C.lower_bound(hi));
+    ASSERT_TRUE(within(S));
+  }
+
+  // joining sets one after the other, including one that was not
+  // kept in shape:
+  for (int j = 0; j < 20; j++)
+  {
+    set<int> other;
+    if (j % 2 == 0)
+      other.balancing(set_balance::scapegoat);
+
+    for (int i = 0; i < 200; i++)
+    {
+      other.insert(100000 + j * 1000 + i);
+      C.insert(100000 + j * 1000 + i);
+    }
+
+    S.join(other);
+    ASSERT_TRUE(within(S));
+  }
+
+  set<int> E;
+  E.balancing(set_balance::scapegoat);
+  set<int> list;
+  for (int i = 0; i < 1000; i++)
+    list.insert(i);
+  E.join(list);
+  ASSERT_TRUE(within(E));
+
+  ASSERT_EQ(S.size(), (int)C.size());
+  ASSERT_EQ(walk(S), vector<int>(C.begin(), C.end()));
+}
+
+//
+// checks the heap order of a treap through its shape: the same keys
+// must give the same tree whatever order they were inserted in
+//
+TEST(myset, treap)
+{
+  vector<int> keys;
+  for (int i = 0; i < 3000; i++)
+    keys.push_back(i * 2);
+
+  set<int> sorted, shuffled, switched;
+  sorted.balancing(set_balance::treap);
+  shuffled.balancing(set_balance::treap);
+
+  for (int x : keys)
+  {
+    sorted.insert(x);
+    switched.insert(x);
+  }
+
+  std::mt19937 gen(45);
+  std::shuffle(keys.begin(), keys.end(), gen);
+  for (int x : keys)
+    shuffled.insert(shuffled.end(), x);
+
+  switched.balancing(set_balance::treap);
+
+  ASSERT_LE(sorted.height(), 40); // expected ~2.99 log2(n) = 35
+  ASSERT_EQ(sorted.height(), shuffled.height());
+  ASSERT_EQ(sorted.height(), switched.height());
+  ASSERT_EQ(sorted.toPairs(-1), shuffled.toPairs(-1));
+  ASSERT_EQ(sorted.toPairs(-1), switched.toPairs(-1));
+
+  std::set<int> C(keys.begin(), keys.end());
+  ASSERT_EQ(walk(sorted), vector<int>(C.begin(), C.end()));
+
+  // split, join, erase_range and batches keep the heap order:
+  auto halves = sorted.split(3001);
+  halves.first.join(halves.second);
+  ASSERT_EQ(halves.first.toPairs(-1), shuffled.toPairs(-1));
+
+  halves.first.erase_range(1000, 2000);
+  vector<int> odd;
+  for (int i = 1; i < 200; i += 2)
+    odd.push_back(i);
+  halves.first.insert_batch(odd.begin(), odd.end());
+
+  set<int> expected;
+  expected.balancing(set_balance::treap);
+  for (int x : C)
+  {
+    if (x < 1000 || x >= 2000)
+      expected.insert(x);
+  }
+  for (int x : odd)
+    expected.insert(x);
+
+  ASSERT_EQ(halves.first.toPairs(-1), expected.toPairs(-1));
+  ASSERT_EQ(halves.first.height(), expected.height());
+
+  // and a copy is the same treap:
+  set<int> copy = expected;
+  ASSERT_EQ(copy.height(), expected.height());
+  ASSERT_EQ(walk(copy), walk(expected));
+
+  // keys without std::hash can't be kept as a treap, which is a
+  // compile error (M.balancing<set_balance::treap>() doesn't build);
+  // the other modes are named at compile time:
+  set<Movie> M;
+  M.balancing<set_balance::scapegoat>();
+  ASSERT_TRUE(M.balancing() == set_balance::scapegoat);
+}
+
+TEST(persistent_set, copies_share_and_diverge)
+{
+  persistent_set<int> A;
+  std::set<int> C;
+
+  std::mt19937 gen(46);
+  std::uniform_int_distribution<int> distrib(0, 20000);
+
+  for (int i = 0; i < 5000; i++)
+  {
+    int x = distrib(gen);
+    A.insert(x);
+    C.insert(x);
+  }
+
+  ASSERT_EQ(A.size(), (int)C.size());
+  ASSERT_EQ(A.toVector(), vector<int>(C.begin(), C.end()));
+
+  // copies are independent from here on:
+  persistent_set<int> B = A;
+  std::set<int> D = C;
+
+  for (int i = 0; i < 2000; i++)
+  {
+    int x = distrib(gen);
+    B.insert(x);
+    D.insert(x);
+
+    int y = distrib(gen);
+    ASSERT_EQ(A.erase(y), (int)C.erase(y));
+  }
+
+  ASSERT_EQ(A.toVector(), vector<int>(C.begin(), C.end()));
+  ASSERT_EQ(B.toVector(), vector<int>(D.begin(), D.end()));
+  ASSERT_EQ(A.size(), (int)C.size());
+  ASSERT_EQ(B.size(), (int)D.size());
+
+  // an iterator keeps its version alive and unchanged:
+  auto iter = B.begin();
+  B = persistent_set<int>();
+  ASSERT_EQ(B.size(), 0);
+
+  vector<int> walked;
+  for (; iter != B.end(); ++iter)
+    walked.push_back(*iter);
+  ASSERT_EQ(walked, vector<int>(D.begin(), D.end()));
+
+  for (int i = 0; i < 2000; i++)
+  {
+    int x = distrib(gen);
+    ASSERT_EQ(A.contains(x), C.count(x) == 1);
+    ASSERT_EQ(A[x], C.count(x) == 1);
+
+    auto lb = A.lower_bound(x);
+    auto expected = C.lower_bound(x);
+    if (expected == C.end())
+      ASSERT_TRUE(lb == A.end());
+    else
+      ASSERT_EQ(*lb, *expected);
+
+    ASSERT_EQ(A.find(x) != A.end(), C.count(x) == 1);
+  }
+}
+
+TEST(persistent_set, bulk_build)
+{
+  set<string> S;
+  persistent_set<string> E(S.toVector());
+  ASSERT_EQ(E.size(), 0);
+  ASSERT_TRUE(E.begin() == E.end());
+
+  for (int i = 0; i < 1000; i++)
+    S.insert(std::to_string(i * 37 % 1000));
+
+  persistent_set<string> P(S.toVector());
+  persistent_set<string> Q;
+  for (int i = 999; i >= 0; i--)
+    Q.insert(std::to_string(i));
+
+  ASSERT_EQ(P.size(), 1000);
+  ASSERT_EQ(P.toVector(), S.toVector());
+  ASSERT_EQ(Q.toVector(), S.toVector());
+
+  P.insert("x");
+  ASSERT_TRUE(P.contains("x"));
+  ASSERT_FALSE(Q.contains("x"));
+  ASSERT_EQ(P.erase("500"), 1);
+  ASSERT_EQ(P.erase("500"), 0);
+  ASSERT_EQ(P.size(), 1000);
+}
+
+TEST(persistent_set, snapshots_while_writing)
+{
+  const int N = 20000;
+
+  persistent_set<int> S;
+  std::atomic<bool> done(false);
+
+  //
+  // two writers add the evens and the odds in increasing order, so
+  // any consistent version holds 0, 2, ..., 2a-2 and 1, 3, ..., 2b-1
+  // for some a and b:
+  //
+  auto writer = [&](int first) {
+    for (int x = first; x < N; x += 2)
+      S.insert(x);
+  };
+
+  std::thread evens(writer, 0), odds(writer, 1);
+
+  std::thread reader([&]() {
+    while (!done)
+    {
+      persistent_set<int> snap = S.snapshot();
+      vector<int> seen;
+
+      for (auto iter = snap.begin(); iter != snap.end(); ++iter)
+        seen.push_back(*iter);
+
+      int a = 0, b = 0;
+      for (int x : seen)
+      {
+        if (x % 2 == 0)
+          ASSERT_EQ(x, 2 * a++);
+        else
+          ASSERT_EQ(x, 2 * b++ + 1);
+      }
+
+      ASSERT_TRUE(std::is_sorted(seen.begin(), seen.end()));
+      ASSERT_EQ(snap.size(), (int)seen.size());
+    }
+  });
+
+  evens.join();
+  odds.join();
+  done = true;
+  reader.join();
+
+  ASSERT_EQ(S.size(), N);
+
+  // an old snapshot is unchanged by later erases:
+  persistent_set<int> before = S.snapshot();
+  for (int x = 0; x < N; x += 3)
+    ASSERT_EQ(S.erase(x), 1);
+
+  ASSERT_EQ(before.size(), N);
+  ASSERT_EQ(S.size(), N - (N + 2) / 3);
+  ASSERT_TRUE(before.contains(3));
+  ASSERT_FALSE(S.contains(3));
+}
+
+TEST(myset, save_load)
+{
+  set<long long> S;
+  set<string> T;
+
+  std::mt19937 gen(48);
+  std::uniform_int_distribution<long long> distrib(-1000000000000LL, 1000000000000LL);
+
+  for (int i = 0; i < 20000; i++)
+  {
+    S.insert(distrib(gen));
+    T.insert(std::string(i % 7, 'x') + std::to_string(distrib(gen)));
+  }
+
+  // two sets, one after the other, in one stream:
+  std::stringstream stream;
+  S.save(stream);
+  T.save(stream);
+  stream << "rest";
+
+  set<long long> S2;
+  S2.insert(5); // replaced by load
+  S2.load(stream);
+
+  set<string> T2;
+  T2.balancing(set_balance::treap);
+  T2.load(stream);
+
+  std::string rest;
+  stream >> rest;
+  ASSERT_EQ(rest, "rest");
+
+  ASSERT_EQ(S2.size(), S.size());
+  ASSERT_EQ(S2.toVector(), S.toVector());
+  ASSERT_EQ(T2.size(), T.size());
+  ASSERT_EQ(T2.toVector(), T.toVector());
+  ASSERT_TRUE(S2.height() <= 16);
+
+  // the loaded sets are ordinary sets:
+  S2.insert(1);
+  ASSERT_TRUE(S2.contains(1));
+  ASSERT_EQ(S2.erase_range(0, 1000000000000LL) > 0, true);
+  T2.insert("");
+  ASSERT_EQ(*T2.begin(), "");
+  ASSERT_EQ(T2.size(), T.size() + 1);
+
+  // file descriptors, and an empty set:
+  FILE *file = std::tmpfile();
+  int fd = fileno(file);
+
+  set<long long> E;
+  E.save(fd);
+  S.save(fd);
+
+  ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+
+  set<long long> E2, S3;
+  E2.insert(1);
+  E2.load(fd);
+  S3.enable_filter();
+  S3.load(fd);
+  std::fclose(file);
+
+  ASSERT_EQ(E2.size(), 0);
+  ASSERT_TRUE(E2.begin() == E2.end());
+  ASSERT_EQ(S3.toVector(), S.toVector());
+  for (long long x : S.toVector())
+    ASSERT_TRUE(S3.contains(x));
+}
+
+TEST(myset, load_bad_input)
+{
+  set<int> S;
+  for (int i = 0; i < 1000; i++)
+    S.insert(i * 3);
+
+  std::stringstream saved;
+  S.save(saved);
+  std::string bytes = saved.str();
+
+  set<int> T;
+  T.insert(42);
+
+  auto load = [&](const std::string &input) {
+    std::stringstream in(input);
+    T.load(in);
+  };
+
+  ASSERT_THROW(load(""), std::runtime_error);
+  ASSERT_THROW(load("not a set at all, just text"), std::runtime_error);
+  ASSERT_THROW(load(bytes.substr(0, bytes.size() - 10)), std::runtime_error);
+
+  // keys out of order (the last key's low byte is changed to 0):
+  std::string unsorted = bytes;
+  unsorted[unsorted.size() - 8] = 0;
+  ASSERT_THROW(load(unsorted), std::runtime_error);
+
+  // saved with a different key type:
+  set<long long> L;
+  std::stringstream longs(bytes);
+  ASSERT_THROW(L.load(longs), std::runtime_error);
+
+  // ... or of the same size, but read differently:
+  set<float> F;
+  std::stringstream floats(bytes);
+  ASSERT_THROW(F.load(floats), std::runtime_error);
+
+  set<unsigned> U;
+  std::stringstream unsigneds(bytes);
+  ASSERT_THROW(U.load(unsigneds), std::runtime_error);
+
+  // a huge count or chunk length is caught, not allocated:
+  std::string counted = bytes;
+  for (int i = 16; i < 20; i++)
+    counted[i] = (char)0xff;
+  counted[19] = 0x7f; // INT_MAX keys
+  counted[20] = counted[21] = counted[22] = counted[23] = 0;
+  ASSERT_THROW(load(counted), std::runtime_error);
+
+  std::string chunked = bytes;
+  for (int i = 24; i < 28; i++)
+    chunked[i] = (char)0xff;
+  ASSERT_THROW(load(chunked), std::runtime_error);
+
+  // the set is unchanged by a failed load:
+  ASSERT_EQ(T.size(), 1);
+  ASSERT_TRUE(T.contains(42));
+
+  load(bytes);
+  ASSERT_EQ(T.toVector(), S.toVector());
+}
+
+template <typename Layout>
+void check_mapped_set(const string &path)
+{
+  set<long long> S;
+  std::mt19937 gen(49);
+  std::uniform_int_distribution<long long> distrib(-1000000, 1000000);
+
+  for (int i = 0; i < 5000; i++)
+    S.insert(distrib(gen));
+
+  mapped_set<long long, Layout>::write(path, S.toVector());
+
+  mapped_set<long long, Layout> M(path);
+  std::remove(path.c_str()); // the mapping keeps the file alive
+
+  ASSERT_EQ(M.size(), S.size());
+  ASSERT_EQ(M.toVector(), S.toVector());
+
+  for (int i = 0; i < 5000; i++)
+  {
+    long long x = distrib(gen);
+
+    ASSERT_EQ(M.contains(x), S.contains(x));
+    ASSERT_EQ(M.find(x) != M.end(), S.contains(x));
+
+    auto lb = M.lower_bound(x);
+    auto expected = S.lower_bound(x);
+    if (expected == S.end())
+      ASSERT_TRUE(lb == M.end());
+    else
+      ASSERT_EQ(*lb, *expected);
+  }
+}
+
+TEST(mapped_set, layouts)
+{
+  string path = "/tmp/tests_mapped_set_" + std::to_string(getpid());
+
+  check_mapped_set<eytzinger_layout>(path);
+  check_mapped_set<veb_layout>(path);
+  check_mapped_set<sorted_layout>(path);
+}
+
+TEST(mapped_set, empty_and_bad_files)
+{
+  string path = "/tmp/tests_mapped_set_" + std::to_string(getpid());
+
+  mapped_set<int>::write(path, vector<int>());
+  {
+    mapped_set<int> E(path);
+    ASSERT_EQ(E.size(), 0);
+    ASSERT_FALSE(E.contains(0));
+    ASSERT_TRUE(E.begin() == E.end());
+  }
+
+  mapped_set<int>::write(path, vector<int>{1, 2, 3});
+
+  ASSERT_THROW((mapped_set<long long>(path)), std::runtime_error);
+  ASSERT_THROW((mapped_set<float>(path)), std::runtime_error); // same size, other kind
+  ASSERT_THROW((mapped_set<unsigned>(path)), std::runtime_error);
+  ASSERT_THROW((mapped_set<int, sorted_layout>(path)), std::runtime_error);
+
+  // created with the mode open() would give it:
+  struct stat info;
+  mode_t mask = umask(0);
+  umask(mask);
+  ASSERT_EQ(stat(path.c_str(), &info), 0);
+  ASSERT_EQ(info.st_mode & 0777, 0666 & ~mask);
+  ASSERT_THROW((mapped_set<int>(path + ".missing")), std::runtime_error);
+
+  // not a mapped set at all:
+  set<int> S;
+  S.insert(1);
+  FILE *file = std::fopen(path.c_str(), "w");
+  S.save(fileno(file));
+  std::fclose(file);
+
+  ASSERT_THROW((mapped_set<int>(path)), std::runtime_error);
+
+  std::remove(path.c_str());
+}
+
+template <typename TKey>
+void check_compressed_random(TKey lo, TKey hi, int n)
+{
+  std::set<TKey> C;
+  std::mt19937 gen(50);
+  std::uniform_int_distribution<TKey> distrib(lo, hi);
+
+  for (int i = 0; i < n; i++)
+    C.insert(distrib(gen));
+
+  compressed_set<TKey> S(vector<TKey>(C.begin(), C.end()));
+
+  ASSERT_EQ(S.size(), (int)C.size());
+  ASSERT_EQ(S.toVector(), vector<TKey>(C.begin(), C.end()));
+
+  for (int i = 0; i < 5000; i++)
+  {
+    TKey x = distrib(gen);
+
+    ASSERT_EQ(S.contains(x), C.count(x) == 1);
+    ASSERT_EQ(S[x], C.count(x) == 1);
+    ASSERT_EQ(S.find(x) != S.end(), C.count(x) == 1);
+
+    auto lb = S.lower_bound(x);
+    auto expected = C.lower_bound(x);
+    if (expected == C.end())
+      ASSERT_TRUE(lb == S.end());
+    else
+    {
+      ASSERT_EQ(*lb, *expected);
+      ++lb, ++expected; // and iteration goes on from there
+      if (expected == C.end())
+        ASSERT_TRUE(lb == S.end());
+      else
+        ASSERT_EQ(*lb, *expected);
+    }
+  }
+}
+
+TEST(compressed_set, random)
+{
+  check_compressed_random<long long>(-100000, 100000, 20000);      // dense
+  check_compressed_random<long long>(LLONG_MIN, LLONG_MAX, 20000); // gaps of any size
+  check_compressed_random<int>(0, 1000000, 1000);                  // a partial last block
+  check_compressed_random<unsigned long long>(0, ULLONG_MAX, 300);
+}
+
+TEST(compressed_set, empty_and_small)
+{
+  compressed_set<long long> E((vector<long long>()));
+  ASSERT_EQ(E.size(), 0);
+  ASSERT_FALSE(E.contains(0));
+  ASSERT_TRUE(E.begin() == E.end());
+  ASSERT_TRUE(E.lower_bound(0) == E.end());
+
+  vector<long long> keys;
+  for (long long i = 0; i < 1000000; i++)
+    keys.push_back(i * 1000);
+
+  compressed_set<long long> S(keys);
+  ASSERT_TRUE(S.bytes() < 3 * keys.size()); // 2 bytes per key, plus the index
+  ASSERT_TRUE(S.contains(999999000));
+  ASSERT_FALSE(S.contains(999999001));
+  ASSERT_TRUE(S.lower_bound(999999001) == S.end());
+
+  ASSERT_THROW(compressed_set<int>(vector<int>{1, 3, 2}), std::invalid_argument);
+  ASSERT_THROW(compressed_set<int>(vector<int>{1, 1}), std::invalid_argument);
+}